@@ -0,0 +1,541 @@
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "setting.h"
+
+// Room for the largest payload of the sweep, the services decode frames of BUFLEN bytes.
+#define FRAMING_MAX_PAYLOAD 1024
+#include "framing.h"
+#include "protocol.h"
+#include "serialport.h"
+#include "statistics.h"
+
+#ifdef BENCH_QSERIALPORT
+#include <QTimer>
+#include <QEventLoop>
+#include <QSerialPort>
+#include <QCoreApplication>
+#endif
+
+// Throughput and per-frame latency of the UART paths, server writer to client reader: a writer
+// thread frames numbered payloads and writes them in batches, paced to the baud rate, the receiver
+// under test decodes them and looks up when each one was written. Every combination of payload
+// size, batch size and baud rate is one run, the results are printed as JSON. With --corrupt the
+// writer damages some frames on the wire, every other frame must still arrive, in order.
+
+constexpr uint64_t SECOND{1000000000};
+constexpr int BITS_PER_BYTE{10}; // 8N1: start bit, 8 data bits, stop bit
+
+struct Run
+{
+    size_t payload{BUFLEN}; // Bytes per frame before framing
+    int batch{1};           // Frames per write()
+    int baud{BAUDRATE};
+    double load{0.8};       // Share of the baud rate the writer uses
+    double corrupt{0};      // Probability of a frame being damaged on the wire
+    int frames{0};
+    std::string device;     // Loopback adapter (TX wired to RX), empty for a PTY pair
+};
+
+struct Link
+{
+    int writer{-1};     // Where the frames are written
+    std::string reader; // Device node the receiver opens
+    SerialPort adapter; // Writer side of a loopback adapter
+};
+
+struct Result
+{
+    int received{0};
+    int damaged{0};      // Frames the decoder dropped
+    int corrupted{0};    // Frames the writer damaged
+    int lost{0};         // Undamaged frames that never arrived, must stay 0
+    int out_of_order{0}; // Frames received after a later one, must stay 0
+    int last_number{-1};
+    uint64_t first{0};         // When the writer started
+    uint64_t last{0};          // When the last frame was received
+    RollingPercentile latency; // us
+    std::vector<uint8_t> arrived; // By frame number
+    explicit Result(size_t frames) : latency{frames}, arrived(frames) {}
+};
+
+static bool open_link(const Run &run, Link &link)
+{
+    if (!run.device.empty())
+    {
+        // Opened before the receiver, which may take the port exclusively.
+        link.reader = run.device;
+        link.writer = link.adapter.open(run.device, run.baud, O_WRONLY) ? link.adapter.descriptor() : -1;
+        return link.writer >= 0;
+    }
+
+    link.writer = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (link.writer < 0 || 0 != grantpt(link.writer) || 0 != unlockpt(link.writer))
+    {
+        return false;
+    }
+    link.reader = ptsname(link.writer);
+    return true;
+}
+
+static void close_link(Link &link)
+{
+    if (link.adapter.isOpen())
+    {
+        link.adapter.close();
+    }
+    else if (link.writer >= 0)
+    {
+        close(link.writer);
+    }
+    else
+    {
+        ;
+    }
+    link.writer = -1;
+}
+
+// Damage an encoded frame by flipping, dropping or inserting one byte before its delimiter. No
+// 0x00 is made or removed, so the frames on either side stay intact, as a resyncing receiver needs.
+static size_t damage(uint8_t *frame, size_t length, std::mt19937 &random)
+{
+    size_t at{std::uniform_int_distribution<size_t>{0, length - 2}(random)};
+    uint8_t byte{static_cast<uint8_t>(std::uniform_int_distribution<int>{1, 255}(random))};
+
+    switch (std::uniform_int_distribution<int>{0, 2}(random))
+    {
+    case 0:
+        frame[at] = (byte == frame[at]) ? static_cast<uint8_t>(byte % 255 + 1) : byte;
+        return length;
+    case 1:
+        std::memmove(frame + at, frame + at + 1, length - at - 1);
+        return length - 1;
+    default:
+        std::memmove(frame + at + 1, frame + at, length - at);
+        frame[at] = byte;
+        return length + 1;
+    }
+}
+
+// Frames carry their number in the first payload bytes, the rest is a pattern with zeros for COBS to replace.
+static void write_frames(const Run &run, int fd, std::vector<std::atomic<uint64_t>> &sent, std::vector<uint8_t> &corrupted, uint64_t start)
+{
+    size_t encoded{FRAMING_ENCODED_LEN(run.payload)};
+    uint64_t period{static_cast<uint64_t>(SECOND * encoded * run.batch * BITS_PER_BYTE / (run.baud * run.load))};
+
+    std::vector<uint8_t> payload(run.payload);
+    std::vector<uint8_t> frames((encoded + 1) * run.batch); // A damaged frame may have a byte more
+    std::mt19937 random{1}; // The same frames are damaged in every run
+    std::bernoulli_distribution corrupt{run.corrupt};
+
+    for (int number = 0, batch = 0; number < run.frames; batch++)
+    {
+        uint64_t due{start + batch * period};
+        // Sleep most of the way, spin the rest.
+        for (uint64_t now = Protocol::now(); now < due; now = Protocol::now())
+        {
+            if (due - now > 200000)
+            {
+                usleep(static_cast<useconds_t>((due - now - 100000) / 1000));
+            }
+        }
+
+        int first{number};
+        size_t length{0};
+        for (; number < run.frames && number - first < run.batch; number++)
+        {
+            for (size_t byte = 0; byte < run.payload; byte++)
+            {
+                payload[byte] = (byte < sizeof(number)) ? static_cast<uint8_t>(number >> (8 * byte)) : static_cast<uint8_t>(byte * 37 % 11);
+            }
+            size_t written{framing_encode(payload.data(), run.payload, frames.data() + length)};
+
+            corrupted[number] = (run.corrupt > 0 && corrupt(random)) ? 1 : 0;
+            length += corrupted[number] ? damage(frames.data() + length, written, random) : written;
+        }
+
+        uint64_t now{Protocol::now()};
+        for (int frame = first; frame < number; frame++)
+        {
+            sent[frame].store(now, std::memory_order_release);
+        }
+
+        for (size_t done = 0; done < length;)
+        {
+            ssize_t written{write(fd, frames.data() + done, length - done)};
+            if (written > 0)
+            {
+                done += written;
+            }
+            else if (written < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                return;
+            }
+            else
+            {
+                pollfd pfd{fd, POLLOUT, 0};
+                poll(&pfd, 1, 10);
+            }
+        }
+    }
+}
+
+// Feed received bytes to the decoder and time every complete frame.
+static void receive(const Run &run, const uint8_t *bytes, size_t length, framing_decoder_t &decoder,
+                    const std::vector<std::atomic<uint64_t>> &sent, Result &result)
+{
+    uint64_t now{Protocol::now()};
+
+    for (size_t i = 0; i < length; i++)
+    {
+        int size{framing_feed(&decoder, bytes[i])};
+        if (size < 0)
+        {
+            result.damaged++;
+        }
+        else if (size > 0 && static_cast<size_t>(size) == run.payload)
+        {
+            size_t number{0};
+            for (size_t byte = 0; byte < run.payload && byte < sizeof(int); byte++)
+            {
+                number |= static_cast<size_t>(decoder.data[byte]) << (8 * byte);
+            }
+
+            // Payloads shorter than an int carry the low bytes only, counted on from the frame expected next
+            if (run.payload < sizeof(int))
+            {
+                size_t expected{static_cast<size_t>(result.last_number + 1)};
+                size_t mask{(static_cast<size_t>(1) << (8 * run.payload)) - 1};
+                number = expected + ((number - expected) & mask);
+            }
+            else
+            {
+                ;
+            }
+
+            if (number < sent.size())
+            {
+                result.out_of_order += (static_cast<int>(number) <= result.last_number) ? 1 : 0;
+                result.last_number = static_cast<int>(number);
+                result.arrived[number] = 1;
+                result.received++;
+                result.last = now;
+                result.latency.add(static_cast<int64_t>(now - sent[number].load(std::memory_order_acquire)) / 1000);
+            }
+        }
+        else
+        {
+            ;
+        }
+    }
+}
+
+// After a run: which frames were damaged, and whether all others arrived.
+static void tally(const std::vector<uint8_t> &corrupted, Result &result)
+{
+    for (size_t number = 0; number < corrupted.size(); number++)
+    {
+        result.corrupted += corrupted[number];
+        result.lost += (!corrupted[number] && !result.arrived[number]) ? 1 : 0;
+    }
+}
+
+// How long a run waits for more frames: a batch on the wire plus the liveness timeout.
+static int silence(const Run &run)
+{
+    return static_cast<int>(FRAMING_ENCODED_LEN(run.payload) * run.batch * BITS_PER_BYTE * 1000ull / run.baud) + Setting::UART::LIVENESS_TIMEOUT;
+}
+
+static bool bench_termios(const Run &run, Result &result)
+{
+    Link link;
+    SerialPort serial;
+
+    // As the client reads: the port polls readable once a whole frame is buffered.
+    if (!open_link(run, link) || !serial.open(link.reader, run.baud, O_RDONLY, std::min<size_t>(FRAMING_ENCODED_LEN(run.payload), 255)))
+    {
+        close_link(link);
+        return false;
+    }
+
+    std::vector<std::atomic<uint64_t>> sent(run.frames);
+    std::vector<uint8_t> corrupted(run.frames);
+    result.first = Protocol::now() + 50 * 1000000ull; // Give the receiver time to wait
+    std::thread writer{write_frames, std::cref(run), link.writer, std::ref(sent), std::ref(corrupted), result.first};
+
+    int epfd{epoll_create1(EPOLL_CLOEXEC)};
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = serial.descriptor();
+    epoll_ctl(epfd, EPOLL_CTL_ADD, serial.descriptor(), &event);
+
+    framing_decoder_t decoder{};
+    uint8_t chunk[4096];
+
+    // Until all frames are in, or nothing arrived for a while.
+    while (result.received < run.frames && epoll_wait(epfd, &event, 1, silence(run)) > 0)
+    {
+        ssize_t length;
+        while ((length = serial.read(chunk, sizeof(chunk))) > 0)
+        {
+            receive(run, chunk, length, decoder, sent, result);
+        }
+    }
+
+    writer.join();
+    tally(corrupted, result);
+    close(epfd);
+    close_link(link);
+    return true;
+}
+
+#ifdef BENCH_QSERIALPORT
+static bool bench_qserialport(const Run &run, Result &result)
+{
+    Link link;
+    QSerialPort serial;
+
+    if (!open_link(run, link))
+    {
+        close_link(link);
+        return false;
+    }
+
+    serial.setPortName(QString::fromStdString(link.reader));
+    serial.setBaudRate(run.baud);
+    serial.setDataBits(QSerialPort::Data8);
+    serial.setParity(QSerialPort::NoParity);
+    serial.setStopBits(QSerialPort::OneStop);
+    serial.setFlowControl(QSerialPort::NoFlowControl);
+
+    if (!serial.open(QIODevice::ReadOnly))
+    {
+        close_link(link);
+        return false;
+    }
+
+    std::vector<std::atomic<uint64_t>> sent(run.frames);
+    std::vector<uint8_t> corrupted(run.frames);
+    result.first = Protocol::now() + 50 * 1000000ull;
+    std::thread writer{write_frames, std::cref(run), link.writer, std::ref(sent), std::ref(corrupted), result.first};
+
+    QEventLoop loop;
+    QTimer quiet; // Ends the run if nothing arrived for a while
+    quiet.setSingleShot(true);
+    framing_decoder_t decoder{};
+    uint8_t chunk[4096];
+
+    // The same path as the client's UARTService: readyRead, read into a fixed buffer, decode in place.
+    QObject::connect(&serial, &QSerialPort::readyRead, &loop, [&]()
+                     {
+        qint64 length;
+        while ((length = serial.read(reinterpret_cast<char *>(chunk), sizeof(chunk))) > 0)
+        {
+            receive(run, chunk, length, decoder, sent, result);
+        }
+
+        if (result.received >= run.frames)
+        {
+            loop.quit();
+        }
+        quiet.start(silence(run)); });
+    QObject::connect(&quiet, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+    quiet.start(silence(run));
+    loop.exec();
+
+    writer.join();
+    tally(corrupted, result);
+    serial.close();
+    close_link(link);
+    return true;
+}
+#endif
+
+// One element of the results array on stdout, one line of progress on stderr.
+static void report(bool comma, const char *backend, const Run &run, bool ran, Result &result)
+{
+    size_t encoded{FRAMING_ENCODED_LEN(run.payload)};
+    double seconds{(result.last > result.first) ? static_cast<double>(result.last - result.first) / SECOND : 0};
+
+    std::printf("%s\n    {\"backend\": \"%s\", \"payload\": %zu, \"batch\": %d, \"baud\": %d, \"load\": %.2f, ",
+                comma ? "," : "", backend, run.payload, run.batch, run.baud, run.load);
+
+    if (!ran)
+    {
+        std::printf("\"error\": \"cannot open %s\"}", run.device.empty() ? "a PTY pair" : run.device.c_str());
+        std::fprintf(stderr, "%-11s could not open %s\n", backend, run.device.empty() ? "a PTY pair" : run.device.c_str());
+        return;
+    }
+
+    // Efficiency is payload over framed bytes, wire efficiency also counts the start and stop bits.
+    std::printf("\"frames\": %d, \"received\": %d, \"corrupted\": %d, \"damaged\": %d, \"lost\": %d, \"out_of_order\": %d, "
+                "\"frames_per_second\": %.1f, \"efficiency\": %.3f, \"wire_efficiency\": %.3f, "
+                "\"latency_us\": {\"p50\": %lld, \"p99\": %lld, \"p999\": %lld, \"max\": %lld}}",
+                run.frames, result.received, result.corrupted, result.damaged, result.lost, result.out_of_order,
+                seconds > 0 ? result.received / seconds : 0.0,
+                static_cast<double>(run.payload) / encoded,
+                static_cast<double>(run.payload * 8) / (encoded * BITS_PER_BYTE),
+                static_cast<long long>(result.latency.percentile(50)),
+                static_cast<long long>(result.latency.percentile(99)),
+                static_cast<long long>(result.latency.percentile(99.9)),
+                static_cast<long long>(result.latency.percentile(100)));
+
+    std::fprintf(stderr, "%-11s %4zu bytes x %3d at %8d baud: %d/%d frames, %d corrupted, %d lost, %d out of order, p50 %lld us, p99 %lld us\n",
+                 backend, run.payload, run.batch, run.baud, result.received, run.frames, result.corrupted, result.lost, result.out_of_order,
+                 static_cast<long long>(result.latency.percentile(50)),
+                 static_cast<long long>(result.latency.percentile(99)));
+}
+
+// Comma separated numbers from 1 to maximum.
+static bool parse_list(const char *text, std::vector<int> &list, long maximum)
+{
+    list.clear();
+    for (const char *item = text; *item != '\0';)
+    {
+        char *end{nullptr};
+        long value{std::strtol(item, &end, 10)};
+
+        if (end == item || value < 1 || value > maximum || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        list.push_back(static_cast<int>(value));
+        item = (*end == ',') ? end + 1 : end;
+    }
+    return !list.empty();
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(stderr, "Usage: %s [--sizes N,...] [--batches N,...] [--bauds N,...] [--load L] [--corrupt P] [--frames N] [--duration MS] [--device DEVICE]\n"
+                         "  --sizes     Payload bytes per frame, up to %d (default %d,16,64,256)\n"
+                         "  --batches   Frames per write (default 1,8)\n"
+                         "  --bauds     Baud rates (default 115200,%d)\n"
+                         "  --load      Share of the baud rate the writer uses, above 0 and up to 1 (default 0.8)\n"
+                         "  --corrupt   Probability of each frame being damaged on the wire, by a flipped, lost or extra byte (default 0)\n"
+                         "  --frames    Most frames per run (default 5000)\n"
+                         "  --duration  Longest a run writes for in ms, slow runs send fewer frames (default 1000)\n"
+                         "  --device    Loopback adapter with TX wired to RX, e.g. an FTDI or CP210x (default a PTY pair)\n"
+                         "Results go to stdout as JSON, progress to stderr. Exits non-zero if an undamaged frame is lost or out of order.\n",
+                 name, FRAMING_MAX_PAYLOAD, BUFLEN, BAUDRATE);
+}
+
+int main(int argc, char **argv)
+{
+#ifdef BENCH_QSERIALPORT
+    QCoreApplication application(argc, argv);
+#endif
+    std::vector<int> sizes{BUFLEN, 16, 64, 256};
+    std::vector<int> batches{1, 8};
+    std::vector<int> bauds{115200, BAUDRATE};
+    double load{0.8};
+    double corrupt{0};
+    int frames{5000};
+    int duration{1000};
+    std::string device;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool valid{i + 1 < argc};
+
+        if (valid && 0 == strcmp(argv[i], "--sizes"))
+        {
+            valid = parse_list(argv[++i], sizes, FRAMING_MAX_PAYLOAD);
+        }
+        else if (valid && 0 == strcmp(argv[i], "--batches"))
+        {
+            valid = parse_list(argv[++i], batches, 1024);
+        }
+        else if (valid && 0 == strcmp(argv[i], "--bauds"))
+        {
+            valid = parse_list(argv[++i], bauds, 100000000);
+        }
+        else if (valid && 0 == strcmp(argv[i], "--load"))
+        {
+            load = std::atof(argv[++i]);
+            valid = load > 0 && load <= 1;
+        }
+        else if (valid && 0 == strcmp(argv[i], "--corrupt"))
+        {
+            corrupt = std::atof(argv[++i]);
+            valid = corrupt >= 0 && corrupt <= 1;
+        }
+        else if (valid && 0 == strcmp(argv[i], "--frames"))
+        {
+            frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--duration"))
+        {
+            duration = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--device"))
+        {
+            device = argv[++i];
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+#ifndef BENCH_QSERIALPORT
+    std::fprintf(stderr, "QSerialPort not built, needs Qt6 SerialPort\n");
+#endif
+    std::printf("{\n  \"link\": \"%s\",\n  \"results\": [", device.empty() ? "pty" : device.c_str());
+    bool comma{false};
+    bool intact{true};
+
+    for (int baud : bauds)
+    {
+        for (int size : sizes)
+        {
+            for (int batch : batches)
+            {
+                Run run;
+                run.payload = size;
+                run.batch = batch;
+                run.baud = baud;
+                run.load = load;
+                run.corrupt = corrupt;
+                run.device = device;
+
+                // What the link carries in the duration, at least enough frames for the percentiles.
+                double per_second{baud * load / (FRAMING_ENCODED_LEN(run.payload) * BITS_PER_BYTE)};
+                run.frames = std::clamp(static_cast<int>(per_second * duration / 1000), std::min(frames, 1000), frames);
+
+                Result termios{static_cast<size_t>(run.frames)};
+                report(comma, "termios", run, bench_termios(run, termios), termios);
+                intact &= termios.lost == 0 && termios.out_of_order == 0;
+                comma = true;
+
+#ifdef BENCH_QSERIALPORT
+                Result qserialport{static_cast<size_t>(run.frames)};
+                report(comma, "qserialport", run, bench_qserialport(run, qserialport), qserialport);
+                intact &= qserialport.lost == 0 && qserialport.out_of_order == 0;
+#endif
+                std::fflush(stdout);
+            }
+        }
+    }
+
+    std::printf("\n  ]\n}\n");
+    return intact ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,928 @@
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include "setting.h"
+#include "bridge.h"
+#include "statistics.h"
+
+// The server ESP32's queue and the client ESP32's re-framing from shared/bridge.h, driven in
+// simulated time: frames arrive on the UART at a fixed rate, the BLE link takes a number of
+// notifications per connection event, each as full of frames as the MTU allows, may refuse some and stall. Reports drops and queue delays per run as JSON, plus what
+// the bridge calls cost per frame on this machine, a check of the ring under two real threads and
+// of how the notify task is woken, by task notifications or by polling every tick. Deterministic
+// checks of the bridge calls run first, any failed check, lost frame or torn slot exits non-zero.
+
+constexpr int64_t SECOND_US{1000000};
+
+struct Options
+{
+    std::vector<int> rates{1000 / Setting::INTERVAL, 250, 1000}; // Frames per second on the UART
+    int interval{30};   // ms between BLE connection events
+    int per_event{4};   // Notifications per connection event
+    int mtu{BRIDGE_ATT_MTU_MIN}; // Negotiated ATT MTU, bounds the frames per notification
+    int stall{0};       // ms the link stops taking frames
+    int stall_every{1000}; // ms from the start of one stall to the next
+    double urgent{0.05};   // Share of frames that flip an urgent signal
+    double damage{0};      // Probability of a corrupted byte on the UART
+    double fail{0};        // Probability of a notification the BLE stack refuses, e.g. BLE_HS_ENOMEM
+    int duration{60};      // Simulated seconds per run
+    int policy{BRIDGE_DROP_POLICY};
+    int mode{BRIDGE_MODE};
+    int stress{1000000};   // Frames through the ring in the two-thread check, 0 to skip it
+    int wake{2000};        // Frames in each wakeup check, 0 to skip it
+    int tick{10};          // ms per FreeRTOS tick, CONFIG_FREERTOS_HZ 100 by default
+};
+
+struct Checks
+{
+    int run{0};
+    std::vector<std::string> failed; // What the failed checks expected
+};
+
+struct Stress
+{
+    uint64_t pushed{0};
+    uint64_t taken{0};
+    uint64_t dropped{0};
+    uint64_t out_of_order{0}; // Frames taken after a newer one
+    uint64_t torn{0};         // Frames whose bytes do not match their seq, a slot read while it was written
+    double ns_per_frame{0};
+};
+
+struct Wake
+{
+    uint32_t received{0};
+    uint32_t delivered{0};
+    uint32_t lost{0};       // Frames neither delivered nor dropped or superseded, must stay 0
+    uint32_t wakeups{0};    // Times the notify task ran
+    uint32_t idle{0};       // Of those with nothing to send
+    uint32_t missed{0};     // Waits that timed out with a frame pending, must stay 0
+    double seconds{0};
+    RollingPercentile delay; // us from the UART to the client, for frames written after the subscription
+    explicit Wake(size_t frames) : delay{frames} {}
+};
+
+// xTaskNotifyGive and ulTaskNotifyTake(pdTRUE, ...) on the host: a count that wakes one waiting
+// thread, kept when nobody waits, and cleared by the take.
+struct TaskNotification
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint32_t count{0};
+
+    void give(void)
+    {
+        {
+            std::scoped_lock lock(mtx);
+            count++;
+        }
+        cv.notify_one();
+    }
+
+    bool take(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock lock(mtx);
+        bool given{cv.wait_for(lock, timeout, [this]() { return count > 0; })};
+        count = 0;
+        return given;
+    }
+};
+
+struct Result
+{
+    uint32_t damaged{0};
+    uint32_t notifications{0};
+    uint32_t delivered{0};    // Frames the client bridge turned into valid UART frames
+    uint32_t overtaken{0};    // Of those, frames an urgent one overtook, logged but older than the state
+    uint32_t out_of_order{0}; // Frames taken for the state after a newer one, must stay 0
+    uint32_t lost{0};         // Frames neither delivered, dropped, superseded nor still queued, must stay 0
+    int max_queued{0};
+    RollingPercentile urgent;
+    RollingPercentile normal;
+    explicit Result(size_t frames) : urgent{frames}, normal{frames} {}
+};
+
+static bool stalled(const Options &options, int64_t now_us)
+{
+    return options.stall > 0 && (now_us / 1000) % options.stall_every < options.stall;
+}
+
+// One run at one UART rate, bridge is the server bridge the frames go through.
+static void simulate(const Options &options, int rate, bridge_server_t &bridge, Result &result)
+{
+    std::mt19937 random{1}; // Same frames for every run
+    std::bernoulli_distribution flip{options.urgent};
+    std::bernoulli_distribution damage{options.damage};
+    std::mt19937 link{3}; // Apart from the frames, so they stay the same with failures
+    std::bernoulli_distribution refuse{options.fail};
+
+    framing_decoder_t client{}; // The desktop client's decoder behind the client bridge
+    int32_t newest{-1};         // And the seq of its state, see bridge_overtaken()
+    uint8_t payload[BRIDGE_FRAME_LEN]{};
+    uint8_t uart[BRIDGE_UNPACKED_MAX];
+    uint8_t packet[BRIDGE_PACKED_MAX];
+    size_t capacity{std::min<size_t>(options.mtu - BRIDGE_ATT_OVERHEAD, sizeof(packet))};
+    int64_t next_frame{0};
+    int64_t next_event{options.interval * 1000};
+    int last{-1}; // Number of the last frame at the client
+    int number{0};
+
+    // When each frame reached the UART and whether it flipped an urgent bit, by its 16 bit number.
+    std::vector<int64_t> written(1 << 16);
+    std::vector<bool> urgent(1 << 16);
+
+    // The mode as the desktop server sets it, with a control frame ahead of the data.
+    size_t control{bridge_control_mode(options.mode, uart)};
+    bridge_uart_rx(&bridge, uart, control, 0);
+
+    for (int64_t now = 0; now < options.duration * SECOND_US;)
+    {
+        if (next_frame <= next_event)
+        {
+            now = next_frame;
+            next_frame = static_cast<int64_t>(++number) * SECOND_US / rate;
+
+            // The first 16 bits count the frames, the urgent bits flip now and then.
+            payload[0] = static_cast<uint8_t>(number);
+            payload[1] = static_cast<uint8_t>(number >> 8);
+            urgent[number & 0xFFFF] = flip(random);
+            payload[2] ^= urgent[number & 0xFFFF] ? 0x40 : 0x00;
+            written[number & 0xFFFF] = now;
+
+            size_t length{framing_encode(payload, BRIDGE_FRAME_LEN, uart)};
+            for (size_t i = 0; options.damage > 0 && i < length; i++)
+            {
+                uart[i] ^= damage(random) ? 0x10 : 0x00;
+            }
+
+            bridge_uart_rx(&bridge, uart, length, now);
+            result.max_queued = std::max(result.max_queued, bridge_ring_size(&bridge.urgent) + bridge_ring_size(&bridge.normal));
+            continue;
+        }
+
+        now = next_event;
+        next_event += options.interval * 1000;
+
+        for (int sent = 0; sent < options.per_event && !stalled(options, now); sent++)
+        {
+            size_t length;
+            int frames{bridge_pack(&bridge, packet, capacity, &length)};
+            if (frames == 0)
+            {
+                break;
+            }
+
+            // A refused notification takes its place in the connection event, its frames go in the next one.
+            bool taken{!refuse(link)};
+            bridge_notified(&bridge, frames, taken, now);
+            if (!taken)
+            {
+                continue;
+            }
+            result.notifications++;
+
+            length = bridge_client_rx(packet, length, uart, sizeof(uart));
+            for (size_t i = 0; i < length; i++)
+            {
+                if (framing_feed(&client, uart[i]) == BRIDGE_TAGGED_LEN)
+                {
+                    int at{client.data[0] | (client.data[1] << 8)};
+                    result.delivered++;
+                    (urgent[at] ? result.urgent : result.normal).add(now - written[at]);
+
+                    // Overtaken frames only go to a log. Numbers wrap at 16 bits, a step back within half of that is a reorder.
+                    if (bridge_overtaken(client.data, &newest))
+                    {
+                        result.overtaken++;
+                        continue;
+                    }
+                    result.out_of_order += (last >= 0 && static_cast<int16_t>(at - last) <= 0) ? 1 : 0;
+                    last = at;
+                }
+            }
+        }
+    }
+    result.damaged = bridge.decoder.bad;
+
+    uint32_t queued{static_cast<uint32_t>(bridge.held_count + bridge_ring_size(&bridge.urgent) + bridge_ring_size(&bridge.normal))};
+    result.lost = bridge.received - result.delivered - bridge_dropped(&bridge) - bridge.superseded - queued;
+}
+
+// Wall time of the bridge calls per frame, the UART side and the notify side on their own.
+static void cost(double &uart_ns, double &notify_ns)
+{
+    constexpr int FRAMES{1000000};
+    static bridge_server_t bridge;
+    bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+    uint8_t payload[BRIDGE_FRAME_LEN]{};
+    uint8_t uart[FRAMING_ENCODED_LEN(BRIDGE_FRAME_LEN) * 32];
+    uint8_t packet[BRIDGE_PACKED_MAX];
+    uint8_t value[BRIDGE_UNPACKED_MAX];
+    size_t checksum{0};
+    std::chrono::nanoseconds rx{0}, tx{0};
+
+    // Batches of 32 frames, half of the queue, so none is dropped.
+    for (int number = 0; number < FRAMES; number += 32)
+    {
+        size_t length{0};
+        for (int i = 0; i < 32; i++)
+        {
+            payload[0] = static_cast<uint8_t>(number + i);
+            payload[2] = ((number + i) % 64 == 0) ? 0x40 : 0x00;
+            length += framing_encode(payload, BRIDGE_FRAME_LEN, uart + length);
+        }
+
+        auto start{std::chrono::steady_clock::now()};
+        bridge_uart_rx(&bridge, uart, length, number);
+        auto middle{std::chrono::steady_clock::now()};
+
+        size_t packed;
+        for (int frames; (frames = bridge_pack(&bridge, packet, sizeof(packet), &packed)) > 0;)
+        {
+            bridge_notified(&bridge, frames, true, number);
+            checksum += bridge_client_rx(packet, packed, value, sizeof(value));
+        }
+        auto end{std::chrono::steady_clock::now()};
+
+        rx += middle - start;
+        tx += end - middle;
+    }
+
+    uart_ns = static_cast<double>(rx.count()) / FRAMES;
+    notify_ns = (checksum > 0) ? static_cast<double>(tx.count()) / FRAMES : 0;
+}
+
+// Waiting for the other thread: spin first, then sleep, a yield alone may not let it run on a single core.
+static void backoff(int &spins)
+{
+    if (++spins > 100)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+// A producer and a consumer thread on one ring, the consumer checks every frame. The producer pushes
+// bursts of random length and then waits for the ring to drain to a random level, so the ring runs
+// both empty and full. Every frame must be taken or counted as dropped, in order and intact.
+static void stress(int frames, int policy, Stress &result)
+{
+    static bridge_ring_t ring;
+    bridge_ring_init(&ring, policy);
+    std::atomic<bool> done{false};
+
+    auto start{std::chrono::steady_clock::now()};
+    std::thread producer{[&]()
+                         {
+                             std::mt19937 random{2};
+                             std::uniform_int_distribution<int> burst{1, 2 * BRIDGE_QUEUE_LEN};
+                             std::uniform_int_distribution<int> level{0, BRIDGE_QUEUE_LEN};
+                             bridge_msg_t msg{};
+
+                             for (int number = 0, left = burst(random); number < frames; number++, left--)
+                             {
+                                 if (left == 0)
+                                 {
+                                     for (int drained = level(random), spins = 0; bridge_ring_size(&ring) > drained;)
+                                     {
+                                         backoff(spins);
+                                     }
+                                     left = burst(random);
+                                 }
+
+                                 msg.seq = static_cast<uint32_t>(number);
+                                 for (int byte = 0; byte < BRIDGE_FRAME_LEN; byte++)
+                                 {
+                                     msg.data[byte] = static_cast<uint8_t>(number >> (8 * byte));
+                                 }
+                                 msg.queued_us = ~static_cast<int64_t>(number);
+                                 bridge_ring_push(&ring, &msg);
+                             }
+                             done.store(true, std::memory_order_release);
+                         }};
+
+    bridge_msg_t msg;
+    int64_t last{-1};
+    for (int spins = 0; !done.load(std::memory_order_acquire) || !bridge_ring_empty(&ring);)
+    {
+        if (!bridge_ring_take(&ring, &msg, nullptr))
+        {
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+
+        bool intact{msg.queued_us == ~static_cast<int64_t>(msg.seq)};
+        for (int byte = 0; byte < BRIDGE_FRAME_LEN; byte++)
+        {
+            intact &= msg.data[byte] == static_cast<uint8_t>(msg.seq >> (8 * byte));
+        }
+
+        result.torn += intact ? 0 : 1;
+        result.out_of_order += (static_cast<int64_t>(msg.seq) <= last) ? 1 : 0;
+        last = msg.seq;
+        result.taken++;
+    }
+
+    producer.join();
+    result.ns_per_frame = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) / frames;
+    result.pushed = frames;
+    result.dropped = ring.dropped;
+}
+
+// The firmware's UART task and notify task on two real threads at 1000 frames per second, with a
+// second of silence halfway. The UART task wakes the notify task after queuing frames once a client
+// subscribed, the subscription wakes it for the frames queued before. With tick > 0 the notify task
+// polls every tick instead.
+static void wakeup(int frames, int tick, int policy, Wake &result)
+{
+    auto bridge{std::make_unique<bridge_server_t>()};
+    bridge_server_init(bridge.get(), policy);
+    TaskNotification notification;
+    std::atomic<bool> subscribed{false};
+    std::atomic<bool> done{false};
+    std::vector<int64_t> written(frames);
+
+    auto start{std::chrono::steady_clock::now()};
+    auto now_us{[&]() { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(); }};
+
+    std::thread uart{[&]()
+                     {
+                         uint8_t payload[BRIDGE_FRAME_LEN]{};
+                         uint8_t bytes[FRAMING_ENCODED_LEN(BRIDGE_FRAME_LEN)];
+
+                         for (int number = 0; number < frames; number++)
+                         {
+                             std::this_thread::sleep_until(start + std::chrono::milliseconds(number + ((number >= frames / 2) ? 1000 : 0)));
+
+                             // The client subscribes a tenth into the run.
+                             if (number == frames / 10)
+                             {
+                                 subscribed.store(true, std::memory_order_release);
+                                 notification.give();
+                             }
+
+                             payload[0] = static_cast<uint8_t>(number);
+                             payload[1] = static_cast<uint8_t>(number >> 8);
+                             written[number] = now_us();
+
+                             size_t length{framing_encode(payload, BRIDGE_FRAME_LEN, bytes)};
+                             if (bridge_uart_rx(bridge.get(), bytes, length, written[number]) > 0 && subscribed.load(std::memory_order_acquire) && tick == 0)
+                             {
+                                 notification.give();
+                             }
+                         }
+                         done.store(true, std::memory_order_release);
+                         notification.give();
+                     }};
+
+    uint8_t packet[BRIDGE_PACKED_MAX];
+    uint8_t bytes[BRIDGE_UNPACKED_MAX];
+    framing_decoder_t client{};
+    int base{0}; // Frame numbers wrap at 16 bits
+
+    while (!done.load(std::memory_order_acquire) || bridge_pending(bridge.get()))
+    {
+        if (!subscribed.load(std::memory_order_acquire) || !bridge_pending(bridge.get()))
+        {
+            if (tick > 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(tick));
+            }
+            else if (!notification.take(std::chrono::milliseconds(1000)))
+            {
+                result.missed += (subscribed && bridge_pending(bridge.get())) ? 1 : 0;
+            }
+
+            result.wakeups++;
+            result.idle += (subscribed && bridge_pending(bridge.get())) ? 0 : 1;
+            continue;
+        }
+
+        size_t length;
+        bridge_notified(bridge.get(), bridge_pack(bridge.get(), packet, sizeof(packet), &length), true, now_us());
+        length = bridge_client_rx(packet, length, bytes, sizeof(bytes));
+
+        for (size_t i = 0; i < length; i++)
+        {
+            if (framing_feed(&client, bytes[i]) == BRIDGE_TAGGED_LEN)
+            {
+                int at{client.data[0] | (client.data[1] << 8)};
+                base += (at < (base & 0xFFFF)) ? 0x10000 : 0;
+                base = (base & ~0xFFFF) | at;
+
+                if (base >= frames / 10)
+                {
+                    result.delay.add(now_us() - written[base]);
+                }
+                result.delivered++;
+            }
+        }
+    }
+
+    uart.join();
+    result.seconds = static_cast<double>(now_us()) / SECOND_US;
+    result.received = bridge->received;
+    result.lost = bridge->received - result.delivered - bridge_dropped(bridge.get()) - bridge->superseded;
+}
+
+static void check(Checks &checks, bool passed, const char *what)
+{
+    checks.run++;
+    if (!passed)
+    {
+        checks.failed.emplace_back(what);
+    }
+}
+
+// Frames numbered from first on the UART, every urgent_every-th one flips an urgent bit, 0 for none.
+static int queue(bridge_server_t &bridge, int first, int count, int urgent_every)
+{
+    uint8_t payload[BRIDGE_FRAME_LEN]{};
+    uint8_t uart[FRAMING_ENCODED_LEN(BRIDGE_FRAME_LEN)];
+    int frames{0};
+
+    for (int number = first; number < first + count; number++)
+    {
+        payload[0] = static_cast<uint8_t>(number);
+        payload[1] = static_cast<uint8_t>(number >> 8);
+        payload[2] = (urgent_every > 0 && (number / urgent_every) % 2 == 1) ? 0x40 : 0x00;
+        frames += bridge_uart_rx(&bridge, uart, framing_encode(payload, BRIDGE_FRAME_LEN, uart), number);
+    }
+    return frames;
+}
+
+// Numbers of the frames in client UART bytes, as the desktop client decodes them.
+static std::vector<int> frame_numbers(const uint8_t *bytes, size_t length)
+{
+    framing_decoder_t decoder{};
+    std::vector<int> numbers;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (framing_feed(&decoder, bytes[i]) == BRIDGE_TAGGED_LEN)
+        {
+            numbers.push_back(decoder.data[0] | (decoder.data[1] << 8));
+        }
+    }
+    return numbers;
+}
+
+// Everything queued, through notifications at an MTU and the client bridge. full tells whether each
+// notification but the last held as many frames as fit.
+static std::vector<int> deliver(bridge_server_t &bridge, int mtu, bool &full)
+{
+    uint8_t packet[BRIDGE_PACKED_MAX];
+    uint8_t uart[BRIDGE_UNPACKED_MAX];
+    size_t capacity{static_cast<size_t>(mtu - BRIDGE_ATT_OVERHEAD)};
+    std::vector<int> numbers;
+    size_t length;
+    int short_ones{0};
+
+    full = true;
+    for (int frames; (frames = bridge_pack(&bridge, packet, capacity, &length)) > 0;)
+    {
+        bridge_notified(&bridge, frames, true, 0);
+        full &= short_ones == 0 && length == static_cast<size_t>(frames) * BRIDGE_RECORD_LEN && length <= capacity;
+        short_ones += (static_cast<size_t>(frames) < capacity / BRIDGE_RECORD_LEN) ? 1 : 0;
+
+        std::vector<int> packed{frame_numbers(uart, bridge_client_rx(packet, length, uart, sizeof(uart)))};
+        numbers.insert(numbers.end(), packed.begin(), packed.end());
+    }
+    return numbers;
+}
+
+// Bits of the URGENT signals in SIGNAL_LIST, laid out in the frame as the server inserts them, low bit first.
+static std::vector<uint8_t> urgent_mask(void)
+{
+    Setting::Signal &signal{Setting::Signal::handle()};
+    std::vector<uint8_t> mask(BRIDGE_FRAME_LEN, 0x00);
+
+    for (size_t i = 0; i < signal.size(); i++)
+    {
+        const auto &value{signal[signal.name(i)]};
+        for (int bit = value.start; value.priority == Setting::URGENT && bit < value.start + value.length; bit++)
+        {
+            if (bit / 8 >= BRIDGE_FRAME_LEN)
+            {
+                return {}; // An urgent signal outside the frame the bridges carry
+            }
+            mask[bit / 8] |= static_cast<uint8_t>(1u << (bit % 8));
+        }
+    }
+    return mask;
+}
+
+static std::vector<int> numbered(int first, int count)
+{
+    std::vector<int> numbers(count);
+    for (int i = 0; i < count; i++)
+    {
+        numbers[i] = first + i;
+    }
+    return numbers;
+}
+
+// The bridge calls one at a time with known frames, each result compared with what it must be.
+static void checks(Checks &result)
+{
+    static bridge_server_t bridge;
+    bool full;
+
+    const uint8_t mask[BRIDGE_FRAME_LEN] = BRIDGE_URGENT_MASK;
+    check(result, urgent_mask() == std::vector<uint8_t>(mask, mask + BRIDGE_FRAME_LEN), "BRIDGE_URGENT_MASK holds the bits of the URGENT signals in SIGNAL_LIST");
+
+    // Round trip, urgent frames go first and every frame arrives once.
+    for (int mtu : {BRIDGE_ATT_MTU_MIN, BRIDGE_ATT_MTU})
+    {
+        bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+        queue(bridge, 0, 60, 7); // 7, 14, ... 56 flip the urgent bit
+        bool urgent{bridge_ring_size(&bridge.urgent) == 8};
+        std::vector<int> numbers{deliver(bridge, mtu, full)};
+        std::vector<int> sorted{numbers};
+        std::sort(sorted.begin(), sorted.end());
+
+        check(result, urgent, "frames that flip an urgent bit go to the urgent ring");
+        check(result, numbers.size() > 8 && std::vector<int>(numbers.begin(), numbers.begin() + 9) == std::vector<int>({7, 14, 21, 28, 35, 42, 49, 56, 0}),
+              "queued mode notifies the urgent frames first");
+        check(result, sorted == numbered(0, 60), (mtu == BRIDGE_ATT_MTU_MIN) ? "pack and client rx at MTU 23 deliver every frame" : "pack and client rx at MTU 247 deliver every frame");
+        check(result, full, (mtu == BRIDGE_ATT_MTU_MIN) ? "notifications at MTU 23 are full records only" : "notifications at MTU 247 are full records only");
+        check(result, bridge.sent == 60 && bridge_dropped(&bridge) == 0 && !bridge_pending(&bridge), "all frames sent, none dropped or left");
+    }
+
+    // Client rx on records built by hand: three whole ones, then cut short or of another length.
+    uint8_t value[3 * BRIDGE_RECORD_LEN];
+    uint8_t uart[BRIDGE_UNPACKED_MAX];
+    std::memset(value, 0, sizeof(value));
+    for (int record = 0; record < 3; record++)
+    {
+        value[record * BRIDGE_RECORD_LEN] = BRIDGE_FRAME_LEN;
+        value[record * BRIDGE_RECORD_LEN + 1] = static_cast<uint8_t>(record);
+        value[record * BRIDGE_RECORD_LEN + 1 + BRIDGE_FRAME_LEN] = static_cast<uint8_t>(record); // seq
+    }
+    check(result, frame_numbers(uart, bridge_client_rx(value, sizeof(value), uart, sizeof(uart))) == numbered(0, 3), "client rx frames whole records");
+    check(result, frame_numbers(uart, bridge_client_rx(value, sizeof(value) - 1, uart, sizeof(uart))) == numbered(0, 2), "client rx drops a truncated record");
+    check(result, bridge_client_rx(value, BRIDGE_RECORD_LEN - 1, uart, sizeof(uart)) == 0, "client rx of less than a record is empty");
+    check(result, frame_numbers(uart, bridge_client_rx(value, sizeof(value), uart, 2 * FRAMING_ENCODED_LEN(BRIDGE_TAGGED_LEN) + 1)) == numbered(0, 2),
+          "client rx writes whole frames within capacity");
+    value[BRIDGE_RECORD_LEN] = BRIDGE_FRAME_LEN + 1;
+    check(result, frame_numbers(uart, bridge_client_rx(value, sizeof(value), uart, sizeof(uart))) == numbered(0, 1), "client rx ends at a foreign record");
+    value[0] = 0;
+    check(result, bridge_client_rx(value, sizeof(value), uart, sizeof(uart)) == 0, "client rx of a foreign first record is empty");
+
+    // The desktop client's side: frames older than its state were overtaken, the seq wraps and starts over after a silence.
+    uint8_t tagged[BRIDGE_TAGGED_LEN]{};
+    int32_t newest{-1};
+    auto overtaken{[&](int seq)
+                   {
+                       tagged[BRIDGE_FRAME_LEN] = static_cast<uint8_t>(seq);
+                       tagged[BRIDGE_FRAME_LEN + 1] = static_cast<uint8_t>(seq >> 8);
+                       return bridge_overtaken(tagged, &newest);
+                   }};
+    check(result, !overtaken(56) && overtaken(0) && overtaken(55) && !overtaken(57) && newest == 57, "frames older than the state are overtaken");
+    newest = -1;
+    check(result, !overtaken(0xFFF0) && !overtaken(2) && overtaken(0xFFF5) && newest == 2, "the seq wraps at 16 bits");
+    newest = -1;
+    check(result, !overtaken(3) && newest == 3, "after a silence any seq is taken");
+
+    // Control frames switch the mode and are no data, a frame of their length otherwise is dropped.
+    uint8_t control[FRAMING_ENCODED_LEN(BRIDGE_CONTROL_LEN)];
+    bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+    size_t length{bridge_control_mode(BRIDGE_MODE_LATEST, control)};
+    check(result, length == FRAMING_ENCODED_LEN(BRIDGE_CONTROL_LEN), "control frame length");
+    check(result, bridge_uart_rx(&bridge, control, length, 0) == 0 && bridge.received == 0, "a control frame is no data frame");
+    check(result, bridge.mode == BRIDGE_MODE_LATEST && bridge.normal.policy == BRIDGE_DROP_OLDEST && bridge.urgent.policy == BRIDGE_DROP_OLDEST,
+          "latest mode drops the oldest frames");
+    length = bridge_control_mode(BRIDGE_MODE_QUEUED, control);
+    bridge_uart_rx(&bridge, control, length, 0);
+    check(result, bridge.mode == BRIDGE_MODE_QUEUED && bridge.normal.policy == BRIDGE_DROP_NEWEST, "queued mode restores the drop policy");
+
+    uint8_t unknown[BRIDGE_CONTROL_LEN]{BRIDGE_CONTROL_MODE, 7};
+    bridge_set_mode(&bridge, BRIDGE_MODE_LATEST);
+    bridge_uart_rx(&bridge, control, framing_encode(unknown, BRIDGE_CONTROL_LEN, control), 0);
+    check(result, bridge.mode == BRIDGE_MODE_QUEUED, "an unknown mode is queued mode");
+
+    uint8_t other[BRIDGE_CONTROL_LEN]{BRIDGE_CONTROL_MODE + 1, BRIDGE_MODE_LATEST};
+    bridge_uart_rx(&bridge, control, framing_encode(other, BRIDGE_CONTROL_LEN, control), 0);
+    check(result, bridge.mode == BRIDGE_MODE_QUEUED && bridge.received == 0 && !bridge_pending(&bridge), "another frame of control length is dropped");
+
+    queue(bridge, 0, 1, 0);
+    bridge_uart_rx(&bridge, control, bridge_control_mode(BRIDGE_MODE_QUEUED, control), 0);
+    queue(bridge, 1, 1, 0);
+    check(result, deliver(bridge, BRIDGE_ATT_MTU, full) == numbered(0, 2), "frames around a control frame arrive");
+
+    // A full ring: drop-newest keeps the first frames, drop-oldest the last, both count the rest.
+    bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+    check(result, queue(bridge, 0, BRIDGE_QUEUE_LEN + 10, 0) == BRIDGE_QUEUE_LEN + 10, "frames dropped by a full ring count as received");
+    check(result, bridge_dropped(&bridge) == 10 && bridge.normal.dropped == 10, "drop-newest counts the dropped frames");
+    check(result, deliver(bridge, BRIDGE_ATT_MTU, full) == numbered(0, BRIDGE_QUEUE_LEN), "drop-newest keeps the oldest frames");
+
+    bridge_server_init(&bridge, BRIDGE_DROP_OLDEST);
+    queue(bridge, 0, BRIDGE_QUEUE_LEN + 10, 0);
+    check(result, bridge_dropped(&bridge) == 10 && bridge.normal.dropped == 10, "drop-oldest counts the dropped frames");
+    check(result, deliver(bridge, BRIDGE_ATT_MTU, full) == numbered(10, BRIDGE_QUEUE_LEN), "drop-oldest keeps the newest frames");
+
+    bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+    queue(bridge, 0, BRIDGE_QUEUE_LEN, 0);
+    queue(bridge, BRIDGE_QUEUE_LEN, 1, BRIDGE_QUEUE_LEN); // Flips the urgent bit
+    check(result, bridge_dropped(&bridge) == 0 && bridge_ring_size(&bridge.urgent) == 1, "an urgent frame has room in a full queue");
+    std::vector<int> ahead{numbered(0, BRIDGE_QUEUE_LEN)};
+    ahead.insert(ahead.begin(), BRIDGE_QUEUE_LEN);
+    check(result, deliver(bridge, BRIDGE_ATT_MTU, full) == ahead, "the urgent frame goes ahead of the full queue");
+
+    // Latest-value mode: the newest frame stands for the others and keeps the oldest urgent time.
+    bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+    bridge_set_mode(&bridge, BRIDGE_MODE_LATEST);
+    queue(bridge, 0, 10, 3);
+    bridge_msg_t msg;
+    check(result, bridge_next(&bridge, &msg) && msg.data[0] == 9 && msg.urgent && msg.queued_us == 3, "latest mode takes the newest frame, urgent since the first urgent one");
+    check(result, bridge.superseded == 9 && !bridge_next(&bridge, &msg), "latest mode supersedes the others");
+
+    // A notification the BLE stack refused: its frames go again, first and in parts if the MTU shrank.
+    uint8_t packet[BRIDGE_PACKED_MAX];
+    size_t packed;
+    bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+    queue(bridge, 0, 5, 0);
+    int frames{bridge_pack(&bridge, packet, sizeof(packet), &packed)};
+    bridge_notified(&bridge, frames, false, 0);
+    check(result, frames == 5 && bridge.failed == 1 && bridge.sent == 0 && bridge_pending(&bridge), "a refused notification keeps its frames");
+    queue(bridge, 5, 1, 5); // Flips the urgent bit
+    check(result, deliver(bridge, BRIDGE_ATT_MTU_MIN, full) == numbered(0, 6) && bridge.sent == 6 && !bridge_pending(&bridge),
+          "refused frames go again first, in parts at a smaller MTU");
+
+    bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+    bridge_set_mode(&bridge, BRIDGE_MODE_LATEST);
+    queue(bridge, 0, 2, 1); // 1 flips the urgent bit
+    bridge_notified(&bridge, bridge_pack(&bridge, packet, sizeof(packet), &packed), false, 0);
+    queue(bridge, 2, 1, 0); // And 2 flips it back
+    frames = bridge_pack(&bridge, packet, sizeof(packet), &packed);
+    check(result, frames == 1 && frame_numbers(uart, bridge_client_rx(packet, packed, uart, sizeof(uart))) == numbered(2, 1) && bridge.superseded == 2,
+          "in latest mode a newer frame supersedes refused ones");
+    check(result, bridge_notified(&bridge, frames, true, 10) && bridge.urgent_worst_us == 9 && !bridge_pending(&bridge), "and has waited since the refused urgent one");
+
+    // Resync after lost UART bytes and a damaged frame, only the frames hit are lost.
+    uint8_t frame[FRAMING_ENCODED_LEN(BRIDGE_FRAME_LEN)];
+    uint8_t payload[BRIDGE_FRAME_LEN]{};
+    bridge_server_init(&bridge, BRIDGE_DROP_NEWEST);
+    length = framing_encode(payload, BRIDGE_FRAME_LEN, frame);
+    bridge_uart_rx(&bridge, frame, length / 2, 0);
+    bridge_uart_resync(&bridge);
+    queue(bridge, 1, 1, 0);
+    check(result, bridge.received == 1 && bridge.decoder.bad == 0 && deliver(bridge, BRIDGE_ATT_MTU, full) == numbered(1, 1),
+          "resync drops the partial frame only");
+
+    queue(bridge, 2, 1, 0);
+    payload[0] = 3;
+    length = framing_encode(payload, BRIDGE_FRAME_LEN, frame);
+    frame[1] ^= 0x10;
+    bridge_uart_rx(&bridge, frame, length, 0);
+    queue(bridge, 4, 1, 0);
+    check(result, bridge.decoder.bad == 1 && deliver(bridge, BRIDGE_ATT_MTU, full) == std::vector<int>({2, 4}), "a damaged frame is dropped alone");
+
+    // A saturated link in queued mode: the urgent frames skip the normal backlog, the state only moves forward.
+    Options options;
+    options.stall = 200;
+    options.duration = 10;
+    options.urgent = 0.05;
+    options.policy = BRIDGE_DROP_NEWEST;
+    options.mode = BRIDGE_MODE_QUEUED;
+    bridge_server_init(&bridge, options.policy);
+    Result saturated{static_cast<size_t>(2000 * options.duration)};
+    simulate(options, 2000, bridge, saturated);
+    // Both wait out the stalls, only the normal frames the backlog on top.
+    check(result, bridge.urgent.dropped == 0 && saturated.urgent.percentile(99) * 2 < saturated.normal.percentile(99),
+          "urgent frames wait far less than normal ones under saturation, none is dropped");
+    check(result, saturated.overtaken > 0 && saturated.out_of_order == 0, "the state skips overtaken frames under saturation");
+
+    // A fifth of the notifications refused, below the link's capacity nothing is lost or repeated.
+    options.stall = 0;
+    options.fail = 0.2;
+    bridge_server_init(&bridge, options.policy);
+    Result refused{static_cast<size_t>(250 * options.duration)};
+    simulate(options, 250, bridge, refused);
+    check(result, bridge.failed > 0 && refused.lost == 0 && bridge_dropped(&bridge) == 0 && refused.out_of_order == 0,
+          "refused notifications lose no frame");
+}
+
+// Comma separated numbers from 1 to maximum.
+static bool parse_list(const char *text, std::vector<int> &list, long maximum)
+{
+    list.clear();
+    for (const char *item = text; *item != '\0';)
+    {
+        char *end{nullptr};
+        long value{std::strtol(item, &end, 10)};
+
+        if (end == item || value < 1 || value > maximum || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        list.push_back(static_cast<int>(value));
+        item = (*end == ',') ? end + 1 : end;
+    }
+    return !list.empty();
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(stderr, "Usage: %s [--rates N,...] [--interval MS] [--per-event N] [--mtu N] [--stall MS] [--stall-every MS] [--urgent P] [--damage P] [--fail P] [--duration S] [--policy newest|oldest] [--mode queued|latest] [--stress N] [--wake N] [--tick MS]\n"
+                         "  --rates        Frames per second the desktop server writes to the UART (default %d,250,1000)\n"
+                         "  --interval     BLE connection interval (default 30 ms)\n"
+                         "  --per-event    Notifications the link takes per connection event (default 4)\n"
+                         "  --mtu          ATT MTU the link negotiated, %d to %d (default %d)\n"
+                         "  --stall        The link takes nothing for this long, 0 for never (default 0 ms)\n"
+                         "  --stall-every  Period of the stalls (default 1000 ms)\n"
+                         "  --urgent       Share of frames that flip an urgent signal (default 0.05)\n"
+                         "  --damage       Probability of each UART byte being corrupted (default 0)\n"
+                         "  --fail         Probability of the BLE stack refusing a notification (default 0)\n"
+                         "  --duration     Simulated seconds per rate (default 60)\n"
+                         "  --policy       Frame a full queue drops (default %s)\n"
+                         "  --mode         What the notifications carry, every queued frame or only the newest (default %s)\n"
+                         "  --stress       Frames through the ring in the two-thread check, 0 to skip it (default 1000000)\n"
+                         "  --wake         Frames in each wakeup check, in real time at 1000 per second, 0 to skip it (default 2000)\n"
+                         "  --tick         FreeRTOS tick the polling notify task sleeps for in the wakeup check (default 10 ms)\n"
+                         "Results go to stdout as JSON, exits non-zero if a check fails.\n",
+                 name, 1000 / Setting::INTERVAL, BRIDGE_ATT_MTU_MIN, BRIDGE_ATT_MTU, BRIDGE_ATT_MTU_MIN, (BRIDGE_DROP_POLICY == BRIDGE_DROP_OLDEST) ? "oldest" : "newest",
+                 (BRIDGE_MODE == BRIDGE_MODE_LATEST) ? "latest" : "queued");
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool valid{i + 1 < argc};
+
+        if (valid && 0 == strcmp(argv[i], "--rates"))
+        {
+            valid = parse_list(argv[++i], options.rates, 1000000);
+        }
+        else if (valid && 0 == strcmp(argv[i], "--interval"))
+        {
+            options.interval = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--per-event"))
+        {
+            options.per_event = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--mtu"))
+        {
+            options.mtu = std::clamp(std::atoi(argv[++i]), BRIDGE_ATT_MTU_MIN, BRIDGE_ATT_MTU);
+        }
+        else if (valid && 0 == strcmp(argv[i], "--stall"))
+        {
+            options.stall = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--stall-every"))
+        {
+            options.stall_every = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--urgent"))
+        {
+            options.urgent = std::clamp(std::atof(argv[++i]), 0.0, 1.0);
+        }
+        else if (valid && 0 == strcmp(argv[i], "--damage"))
+        {
+            options.damage = std::clamp(std::atof(argv[++i]), 0.0, 1.0);
+        }
+        else if (valid && 0 == strcmp(argv[i], "--fail"))
+        {
+            options.fail = std::clamp(std::atof(argv[++i]), 0.0, 1.0);
+        }
+        else if (valid && 0 == strcmp(argv[i], "--duration"))
+        {
+            options.duration = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--policy"))
+        {
+            i++;
+            options.policy = (0 == strcmp(argv[i], "oldest")) ? BRIDGE_DROP_OLDEST : BRIDGE_DROP_NEWEST;
+            valid = 0 == strcmp(argv[i], "oldest") || 0 == strcmp(argv[i], "newest");
+        }
+        else if (valid && 0 == strcmp(argv[i], "--mode"))
+        {
+            i++;
+            options.mode = (0 == strcmp(argv[i], "latest")) ? BRIDGE_MODE_LATEST : BRIDGE_MODE_QUEUED;
+            valid = 0 == strcmp(argv[i], "latest") || 0 == strcmp(argv[i], "queued");
+        }
+        else if (valid && 0 == strcmp(argv[i], "--stress"))
+        {
+            options.stress = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--wake"))
+        {
+            options.wake = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (valid && 0 == strcmp(argv[i], "--tick"))
+        {
+            options.tick = std::max(1, std::atoi(argv[++i]));
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const char *policy{(options.policy == BRIDGE_DROP_OLDEST) ? "oldest" : "newest"};
+    const char *mode{(options.mode == BRIDGE_MODE_LATEST) ? "latest" : "queued"};
+    std::printf("{\n  \"interval_ms\": %d, \"per_event\": %d, \"mtu\": %d, \"stall_ms\": %d, \"stall_every_ms\": %d, \"fail\": %.2f, \"queue\": %d, \"policy\": \"%s\", \"mode\": \"%s\",\n",
+                options.interval, options.per_event, options.mtu, options.stall, options.stall_every, options.fail, BRIDGE_QUEUE_LEN, policy, mode);
+
+    Checks checked;
+    checks(checked);
+    bool intact{checked.failed.empty()};
+
+    std::printf("  \"checks\": {\"run\": %d, \"failed\": [", checked.run);
+    for (size_t i = 0; i < checked.failed.size(); i++)
+    {
+        std::printf("%s\"%s\"", (i > 0) ? ", " : "", checked.failed[i].c_str());
+        std::fprintf(stderr, "check failed: %s\n", checked.failed[i].c_str());
+    }
+    std::printf("], \"passed\": %s},\n  \"results\": [", intact ? "true" : "false");
+
+    for (size_t run = 0; run < options.rates.size(); run++)
+    {
+        int rate{options.rates[run]};
+        auto bridge{std::make_unique<bridge_server_t>()}; // Too large for the stack with big queues
+        bridge_server_init(bridge.get(), options.policy);
+        Result result{static_cast<size_t>(std::min<int64_t>(static_cast<int64_t>(rate) * options.duration, 1000000))};
+
+        simulate(options, rate, *bridge, result);
+
+        std::printf("%s\n    {\"rate\": %d, \"received\": %u, \"damaged\": %u, \"dropped\": %u, \"superseded\": %u, "
+                    "\"sent\": %u, \"failed\": %u, \"notifications\": %u, \"frames_per_notification\": %.2f, \"delivered\": %u, \"overtaken\": %u, \"out_of_order\": %u, \"lost\": %u, \"max_queued\": %d, \"queue_delay_us\": {",
+                    (run > 0) ? "," : "", rate, static_cast<unsigned>(bridge->received), static_cast<unsigned>(result.damaged),
+                    static_cast<unsigned>(bridge_dropped(bridge.get())), static_cast<unsigned>(bridge->superseded), static_cast<unsigned>(bridge->sent),
+                    static_cast<unsigned>(bridge->failed), static_cast<unsigned>(result.notifications), (result.notifications > 0) ? static_cast<double>(bridge->sent) / result.notifications : 0.0,
+                    static_cast<unsigned>(result.delivered), static_cast<unsigned>(result.overtaken), static_cast<unsigned>(result.out_of_order), static_cast<unsigned>(result.lost), result.max_queued);
+        intact &= result.lost == 0;
+
+        const char *names[]{"urgent", "normal"};
+        RollingPercentile *delays[]{&result.urgent, &result.normal};
+        for (int priority = 0; priority < 2; priority++)
+        {
+            std::printf("%s\"%s\": {\"p50\": %lld, \"p99\": %lld, \"max\": %lld}", (priority > 0) ? ", " : "", names[priority],
+                        static_cast<long long>(delays[priority]->percentile(50)),
+                        static_cast<long long>(delays[priority]->percentile(99)),
+                        static_cast<long long>(delays[priority]->percentile(100)));
+        }
+        std::printf("}}");
+    }
+
+    double uart_ns, notify_ns;
+    cost(uart_ns, notify_ns);
+    std::printf("\n  ],\n  \"cost_ns_per_frame\": {\"uart_rx\": %.1f, \"notify\": %.1f}", uart_ns, notify_ns);
+
+    if (options.stress > 0)
+    {
+        Stress result;
+        stress(options.stress, options.policy, result);
+        bool passed{result.torn == 0 && result.out_of_order == 0 && result.taken + result.dropped == result.pushed};
+        intact &= passed;
+
+        std::printf(",\n  \"stress\": {\"pushed\": %llu, \"taken\": %llu, \"dropped\": %llu, \"out_of_order\": %llu, \"torn\": %llu, "
+                    "\"ns_per_frame\": %.1f, \"passed\": %s}",
+                    static_cast<unsigned long long>(result.pushed), static_cast<unsigned long long>(result.taken),
+                    static_cast<unsigned long long>(result.dropped), static_cast<unsigned long long>(result.out_of_order),
+                    static_cast<unsigned long long>(result.torn), result.ns_per_frame, passed ? "true" : "false");
+    }
+
+    if (options.wake > 0)
+    {
+        std::printf(",\n  \"wakeup\": {\"tick_ms\": %d", options.tick);
+
+        const char *names[]{"notify", "poll"};
+        for (int tick : {0, options.tick})
+        {
+            Wake result{static_cast<size_t>(options.wake)};
+            wakeup(options.wake, tick, options.policy, result);
+            intact &= result.lost == 0 && result.missed == 0;
+
+            std::printf(",\n    \"%s\": {\"received\": %u, \"delivered\": %u, \"lost\": %u, \"missed\": %u, \"wakeups_per_second\": %.1f, "
+                        "\"idle_wakeups\": %u, \"delay_us\": {\"p50\": %lld, \"p99\": %lld, \"max\": %lld}}",
+                        names[tick > 0], result.received, result.delivered, result.lost, result.missed, result.wakeups / result.seconds, result.idle,
+                        static_cast<long long>(result.delay.percentile(50)), static_cast<long long>(result.delay.percentile(99)),
+                        static_cast<long long>(result.delay.percentile(100)));
+        }
+        std::printf("\n  }");
+    }
+    std::printf("\n}\n");
+
+    return intact ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,39 @@
+#ifndef CANSERVICE_H
+#define CANSERVICE_H
+
+#include "comservice.h"
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+
+class CANClient : public COMService
+{
+
+private:
+
+    int sockfd{-1};
+
+    // The bool to signal the thread to stop.
+    std::atomic<bool> client_window_closed{false};
+    std::thread trd{&CANClient::run, this};
+
+    // Opens a raw CAN socket that only passes Setting::CAN::ID through the kernel filter.
+    bool open_socket(void);
+
+    // The main function for the client logic.
+    void run(void) override;
+
+    public:
+
+    // The constructor, starts the client thread
+    CANClient() = default;
+
+    // The destructor, the receive timeout lets the thread notice the flag.
+    ~CANClient()
+    {
+        client_window_closed = true;
+        trd.join();
+    }
+};
+
+#endif // CANSERVICE_H
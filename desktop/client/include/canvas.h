@@ -121,6 +121,14 @@ public:
      */
     void connection_set_status(bool status);
 
+    /**
+     * @brief Set the one-way latency shown below the connection status.
+     * 
+     * @param median Median latency from the server to this client in microseconds, 0 to hide
+     * @param worst 99th percentile latency from the server to this client in microseconds
+     */
+    void connection_set_latency(int median, int worst);
+
 private:
     QTimer blink_timer = QTimer(this); // Timer for blinking effect
     bool blink_state = false;
@@ -1,11 +1,18 @@
  #ifndef CCOMSERVICE_H
 #define CCOMSERVICE_H
 
+#include <map>
+#include <deque>
 #include <mutex>
+#include <vector>
 #include <atomic>
 #include <cstdint>
 #include <iostream>
 #include "setting.h"
+#include "protocol.h"
+#include "clocksync.h"
+#include "statistics.h"
+#include "history.h"
 
     class COMService
     {
@@ -29,12 +36,99 @@
          */
         void extract(uint32_t start, uint32_t length, int32_t &value);
 
+        RollingPercentile receive_latency;
+        RollingPercentile render_latency;
+
+        // Newest frame on the local clock, used to measure render latency.
+        std::atomic<uint32_t> frame_sequence{0};
+        std::atomic<uint64_t> frame_sent{0};
+        std::atomic<uint64_t> frame_timestamp{0};
+        uint32_t rendered_sequence{0};
+
+        /**
+         * @brief Record the one-way latency of a received frame.
+         * 
+         * @param sequence  Sequence of the frame
+         * @param timestamp Server clock when the frame was sent
+         * @param received  Local clock when the frame arrived
+         */
+        void record(uint32_t sequence, uint64_t timestamp, uint64_t received);
+
+        // Control state, sent again after every reconnect.
+        std::vector<uint8_t> subscription;
+        int requested_interval{-1};
+        int requested_history{-1};
+
+        // Recent samples of the channels a history was requested for, backfilled by the server.
+        std::map<uint16_t, std::deque<History::Sample>> trends;
+
+        /**
+         * @brief Add the newest values of a channel to its trend, at most one sample per Setting::HISTORY::INTERVAL.
+         * 
+         * @param channel   The channel, ignored if no history was requested for it
+         * @param timestamp Server clock of the values
+         * @param payload   The packed signals
+         */
+        void sample(uint16_t channel, uint64_t timestamp, const uint8_t *payload);
+
     protected:
+        /**
+         * @brief Received state of one vehicle.
+         * 
+         */
+        struct Channel
+        {
+            uint8_t buffer[BUFLEN];
+        };
+
         std::mutex mtx;
-        uint8_t buffer[BUFLEN]{};
+
+        /**
+         * @brief All vehicles, indexed by channel ID. UART and CAN frames only carry channel 0.
+         * 
+         */
+        std::vector<Channel> channels = std::vector<Channel>(Setting::CHANNELS, Channel{});
         std::atomic<bool> status{false};
+        ClockSync clock;
         virtual void run(void) = 0;
 
+        /**
+         * @brief Store a received frame and record its one-way latency.
+         * 
+         * @param data Frame from the server, the timestamp is converted with clock. Unknown channels are ignored.
+         */
+        void receive(const Protocol::Data &data);
+
+        /**
+         * @brief Apply a received update to the buffer and record its one-way latency.
+         * 
+         * @param update Update from the server, signals it does not carry keep their value. Unknown channels are ignored.
+         */
+        void receive(const Protocol::Update &update);
+
+        /**
+         * @brief Put the samples of a backfill in front of the live samples of the channel.
+         * 
+         * @param backfill Compressed history from the server
+         */
+        void receive(const Protocol::Backfill &backfill);
+
+        /**
+         * @brief Send a control message to the server.
+         * 
+         * The default does nothing, UART and CAN are one-way links.
+         * 
+         * @param message The framed message
+         */
+        virtual void transmit(const std::vector<uint8_t> &message) { (void)message; }
+
+        /**
+         * @brief The subscription, rate and history requested so far, to restore them on a new connection.
+         * 
+         * @return Framed control messages, empty if nothing was requested
+         */
+        std::vector<uint8_t> control(void);
+
     public:
         /**
          * @brief Get the connection status.
@@ -47,37 +141,94 @@
         /**
          * @brief Get the battery level.
          * 
+         * @param channel The vehicle
          * @return Battery level in percentage, range 0-100
          */
-        uint32_t getBatteryLevel();
+        uint32_t getBatteryLevel(uint16_t channel = 0);
 
         /**
          * @brief Get the temperature.
          * 
+         * @param channel The vehicle
          * @return Temperature in Celsius, range -60 - 60
          */
-        int32_t getTemperature();
+        int32_t getTemperature(uint16_t channel = 0);
 
         /**
          * @brief Get the left indicator state.
          * 
+         * @param channel The vehicle
          * @return true if left indicator is on, false otherwise
          */
-        bool getLeftLight();
+        bool getLeftLight(uint16_t channel = 0);
 
         /**
          * @brief Get the right indicator state.
          * 
+         * @param channel The vehicle
          * @return true if right indicator is on, false otherwise
          */
-        bool getRightLight();
+        bool getRightLight(uint16_t channel = 0);
 
         /**
          * @brief Get the speed.
          * 
+         * @param channel The vehicle
          * @return Speed in km/h, range 0 - 240
          */
-        uint32_t getSpeed();
+        uint32_t getSpeed(uint16_t channel = 0);
+
+        /**
+         * @brief Get the one-way latency from the server sending a frame to receiving it.
+         * 
+         * @param percentile Percentile over the recent frames, range 0 - 100
+         * @return Latency in microseconds, 0 until the clocks are synchronized
+         */
+        uint32_t getLatency(double percentile);
+
+        /**
+         * @brief Get the one-way latency from the server sending a frame to rendering it.
+         * 
+         * @param percentile Percentile over the recent frames, range 0 - 100
+         * @return Latency in microseconds, 0 until the clocks are synchronized
+         */
+        uint32_t getRenderLatency(double percentile);
+
+        /**
+         * @brief Mark the newest received frame as rendered.
+         * 
+         */
+        void rendered(void);
+
+        /**
+         * @brief Tell the server which signals this client shows.
+         * 
+         * @param signals Signal names from SIGNAL_LIST, unknown names are ignored
+         */
+        void subscribe(const std::vector<std::string> &signals);
+
+        /**
+         * @brief Ask the server for a slower update rate, e.g. the render rate.
+         * 
+         * @param interval Milliseconds between frames, 0 = as fast as the server sends
+         */
+        void requestInterval(uint16_t interval);
+
+        /**
+         * @brief Ask the server for the recent history of a channel, again on every reconnect.
+         * 
+         * @param seconds How far back, up to Setting::HISTORY::SECONDS
+         * @param channel The vehicle
+         */
+        void requestHistory(uint16_t seconds, uint16_t channel = 0);
+
+        /**
+         * @brief Get the recent values of a channel, backfilled and live.
+         * 
+         * @param channel The vehicle
+         * @return Samples oldest first on the server clock, empty if no history was requested
+         */
+        std::vector<History::Sample> getHistory(uint16_t channel = 0);
 
         virtual ~COMService() = default;
     };
@@ -2,8 +2,10 @@
 #define TCPSERVICE_H
 
 #include "comservice.h"
+#include <mutex>
 #include <thread>
 #include <atomic>
+#include <vector>
 #include <unistd.h>
 #include <sys/socket.h>
 
@@ -14,6 +16,20 @@ private:
 
     int sockfd;
 
+    // Reassembles messages that arrive split over several reads.
+    Protocol::Parser parser;
+
+    // Messages to the server are written from the GUI thread too, never blocking it.
+    std::mutex tx_mtx;
+    std::vector<uint8_t> outbox;
+    uint64_t last_transmit{0};
+
+    // Write as much of the outbox as the socket takes, tx_mtx must be held.
+    void flush(void);
+
+    // Queue a message for the server and try to write it right away.
+    void transmit(const std::vector<uint8_t> &message) override;
+
     // The bool to signal the thread to stop.
     std::atomic<bool> client_window_closed{false};
     std::thread trd{&TCPClient::run, this};
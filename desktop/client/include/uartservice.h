@@ -3,11 +3,18 @@
 
 #include <QThread>
 #include "comservice.h"
+#include "hotplug.h"
 
 class UARTService : public COMService, public QThread
 {
     void run(void) override;
     std::atomic<bool> end{false};
+
+    /**
+     * @brief Wakes the thread's event loop when the ESP32 is plugged in or removed, wake() ends the loop
+     *
+     */
+    Hotplug hotplug;
     
     public:
     UARTService()
@@ -18,6 +25,7 @@ class UARTService : public COMService, public QThread
     ~UARTService()
     {
         end = true;
+        hotplug.wake();
         wait();
     }
 };
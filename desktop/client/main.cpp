@@ -8,8 +8,11 @@
 #elif defined(COMM_PROTOCOL_TCP)
 #include "tcpservice.h"
 
+#elif defined(COMM_PROTOCOL_CAN)
+#include "canservice.h"
+
 #else
-#error "One of COMM_PROTOCOL_UART or COMM_PROTOCOL_TCP must be defined"
+#error "One of COMM_PROTOCOL_UART, COMM_PROTOCOL_TCP or COMM_PROTOCOL_CAN must be defined"
 #endif
 
 int main(int argc, char **argv)
@@ -19,6 +22,9 @@ int main(int argc, char **argv)
 
 #elif defined(COMM_PROTOCOL_TCP)
     TCPClient com_service;
+
+#elif defined(COMM_PROTOCOL_CAN)
+    CANClient com_service;
 #endif
 
     QApplication app(argc, argv);
@@ -0,0 +1,112 @@
+#include <cerrno>
+#include <cstring>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include "canservice.h"
+
+// Status drops if no frame arrived within this many send intervals.
+constexpr int missed_intervals = 5;
+
+bool CANClient::open_socket(void)
+{
+    sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+    if (sockfd < 0)
+    {
+        return false;
+    }
+
+    ifreq ifr{};
+    strncpy(ifr.ifr_name, Setting::CAN::INTERFACE, IFNAMSIZ - 1);
+
+    bool ready{0 == ioctl(sockfd, SIOCGIFINDEX, &ifr)};
+
+    // Let the kernel drop every frame except ours, so the thread is never woken for other bus traffic.
+    if (ready)
+    {
+        can_filter filter{};
+        filter.can_id = Setting::CAN::ID;
+        filter.can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        ready = (0 == setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter)));
+    }
+
+    if (ready && Setting::CAN::FD)
+    {
+        int enable{1};
+        ready = (0 == setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)));
+    }
+
+    // Wake up regularly to notice a silent bus or a closed window.
+    if (ready)
+    {
+        timeval timeout{};
+        timeout.tv_usec = missed_intervals * Setting::INTERVAL * 1000;
+        ready = (0 == setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)));
+    }
+
+    if (ready)
+    {
+        sockaddr_can addr{};
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = ifr.ifr_ifindex;
+        ready = (0 == bind(sockfd, (sockaddr *)&addr, sizeof(addr)));
+    }
+
+    if (!ready)
+    {
+        close(sockfd);
+        sockfd = -1;
+    }
+
+    return ready;
+}
+
+void CANClient::run(void)
+{
+    canfd_frame frame{}; // Large enough for both classic and FD frames
+
+    while (client_window_closed == false)
+    {
+        if (sockfd < 0)
+        {
+            if (!open_socket())
+            {
+                // Interface missing or down, retry every interval
+                std::this_thread::sleep_for(std::chrono::milliseconds(Setting::INTERVAL));
+                continue;
+            }
+        }
+
+        ssize_t bytes_read{read(sockfd, &frame, sizeof(frame))};
+
+        if ((bytes_read == CAN_MTU || bytes_read == CANFD_MTU) && frame.len >= BUFLEN)
+        {
+            {
+                std::scoped_lock lock{mtx};
+                memcpy(channels[0].buffer, frame.data, BUFLEN);
+            }
+            status = true;
+        }
+        else if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            // No frame within the timeout, the server is gone.
+            status = false;
+        }
+        else if (bytes_read < 0)
+        {
+            // Interface went down, reopen it.
+            status = false;
+            close(sockfd);
+            sockfd = -1;
+        }
+    }
+
+    if (sockfd >= 0)
+    {
+        close(sockfd);
+    }
+    status = false;
+}
@@ -14,6 +14,9 @@ static int battery_icon_size = 50; // Font size for the battery icon
 static bool connection_status = false; // Connection status (true = connected, false = disconnected)
 static int connection_icon_size = 50;  // Font size for the level text
 static int connection_text_size = 20;  // Font size for the battery icon
+static int connection_latency_median = 0; // One-way latency in microseconds, 0 = unknown
+static int connection_latency_worst = 0;
+static int connection_latency_size = 10; // Font size for the latency text
 
 static bool indicator_left = false;
 static bool indicator_right = false;
@@ -188,6 +191,12 @@ void Canvas::connection_set_status(bool status)
     }
 }
 
+void Canvas::connection_set_latency(int median, int worst)
+{
+    connection_latency_median = median;
+    connection_latency_worst = worst;
+}
+
 void Canvas::connection_draw(QPainter &painter, const QPoint &pos)
 {
     if (connection_status)
@@ -207,6 +216,17 @@ void Canvas::connection_draw(QPainter &painter, const QPoint &pos)
         QSize textSize = painter.fontMetrics().size(Qt::TextSingleLine, speedText);
         painter.setPen(Qt::white);                                                      // Set pen color for the text
         painter.drawText(pos.x() - textSize.width() / 2 + 35, pos.y() + 20, speedText); // Draw the speed text below the needle
+
+        if (connection_latency_median > 0)
+        {
+            temp_font.setPointSize(connection_latency_size);
+            painter.setFont(temp_font);
+            QString latencyText = "latency p50 " + QString::number(connection_latency_median / 1000.0, 'f', 1) +
+                                  " ms  p99 " + QString::number(connection_latency_worst / 1000.0, 'f', 1) + " ms";
+            textSize = painter.fontMetrics().size(Qt::TextSingleLine, latencyText);
+            painter.setPen(QColor(160, 160, 160));
+            painter.drawText(pos.x() - textSize.width() / 2 + 35, pos.y() + 40, latencyText); // Draw the latency below the speed text
+        }
     }
     else
     {
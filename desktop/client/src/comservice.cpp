@@ -1,6 +1,7 @@
 #include "comservice.h"
 #include <cstring>
 #include <bitset>
+#include <algorithm>
 #include <iostream>
 
 // Read buffer as little-endian 24-bit integer
@@ -12,15 +13,15 @@ static uint32_t bufferToValue(const uint8_t *buffer)
 // Problem: Lock guard implementation is blocking the canvas updates.
 // Solution i could think of is to run the updates for Comeservice in a seperate thread as to mitigae the blcking issue.
 
-uint32_t COMService::getBatteryLevel()
+uint32_t COMService::getBatteryLevel(uint16_t channel)
 {
 
     uint32_t val{0};
-    if(status)
+    if(status && channel < channels.size())
     {
         {
             std::scoped_lock lock(mtx);
-            val = bufferToValue(buffer);
+            val = bufferToValue(channels[channel].buffer);
         }
             auto sig = signal["battery"];
             extract(sig.start, sig.length, val);
@@ -29,15 +30,15 @@ uint32_t COMService::getBatteryLevel()
     return val;
 }
 
-int32_t COMService::getTemperature()
+int32_t COMService::getTemperature(uint16_t channel)
 {
 
     int32_t val{0};
-    if(status)
+    if(status && channel < channels.size())
     {
         {
             std::scoped_lock lock(mtx);
-            val = static_cast<int32_t>(bufferToValue(buffer));
+            val = static_cast<int32_t>(bufferToValue(channels[channel].buffer));
         }
         auto sig = signal["temperature"];
         extract(sig.start, sig.length, val);
@@ -46,14 +47,14 @@ int32_t COMService::getTemperature()
     return val;
 }
 
-bool COMService::getLeftLight()
+bool COMService::getLeftLight(uint16_t channel)
 {
     uint32_t val{0};
-    if(status)
+    if(status && channel < channels.size())
     {
         {
             std::scoped_lock lock(mtx);
-            val = bufferToValue(buffer);
+            val = bufferToValue(channels[channel].buffer);
         }
         auto sig = signal["signal-left"];
         extract(sig.start, sig.length, val);
@@ -61,14 +62,14 @@ bool COMService::getLeftLight()
     
     return val;
 }
-bool COMService::getRightLight()
+bool COMService::getRightLight(uint16_t channel)
 {
     uint32_t val{0};
-    if(status)
+    if(status && channel < channels.size())
     {
         {
             std::scoped_lock lock(mtx);
-            val = bufferToValue(buffer);
+            val = bufferToValue(channels[channel].buffer);
         }
         auto sig = signal["signal-right"];
         extract(sig.start, sig.length, val);
@@ -76,14 +77,14 @@ bool COMService::getRightLight()
     
     return val;
 }
-uint32_t COMService::getSpeed()
+uint32_t COMService::getSpeed(uint16_t channel)
 {
     uint32_t val{0};
-    if(status)
+    if(status && channel < channels.size())
     {
         {
             std::scoped_lock lock(mtx);
-            val = bufferToValue(buffer);
+            val = bufferToValue(channels[channel].buffer);
         }
         auto sig = signal["speed"];
         extract(sig.start, sig.length, val);
@@ -92,6 +93,228 @@ uint32_t COMService::getSpeed()
     return val;
 }
 
+void COMService::receive(const Protocol::Data &data)
+{
+    uint64_t received{Protocol::now()};
+
+    if (data.channel >= channels.size())
+    {
+        return;
+    }
+
+    {
+        std::scoped_lock lock(mtx);
+        memcpy(channels[data.channel].buffer, data.payload, BUFLEN);
+        sample(data.channel, data.timestamp, data.payload);
+    }
+
+    record(data.sequence, data.timestamp, received);
+}
+
+void COMService::receive(const Protocol::Update &update)
+{
+    uint64_t received{Protocol::now()};
+
+    if (update.channel >= channels.size())
+    {
+        return;
+    }
+
+    {
+        std::scoped_lock lock(mtx);
+        Protocol::apply(update, channels[update.channel].buffer);
+        sample(update.channel, update.timestamp, channels[update.channel].buffer);
+    }
+
+    record(update.sequence, update.timestamp, received);
+}
+
+void COMService::receive(const Protocol::Backfill &backfill)
+{
+    std::vector<History::Sample> samples;
+    if (!History::expand(backfill, samples) || samples.empty())
+    {
+        return;
+    }
+
+    std::scoped_lock lock(mtx);
+    auto trend = trends.find(backfill.channel);
+    if (trend == trends.end())
+    {
+        return;
+    }
+
+    // Live samples from before the end of the backfill are replaced, the ones after it are kept.
+    std::deque<History::Sample> merged(samples.begin(), samples.end());
+    for (const auto &live : trend->second)
+    {
+        if (live.timestamp > samples.back().timestamp)
+        {
+            merged.push_back(live);
+        }
+    }
+
+    while (merged.size() > Setting::HISTORY::SECONDS * 1000 / Setting::HISTORY::INTERVAL)
+    {
+        merged.pop_front();
+    }
+    trend->second = std::move(merged);
+}
+
+void COMService::sample(uint16_t channel, uint64_t timestamp, const uint8_t *payload)
+{
+    auto trend = trends.find(channel);
+    if (trend == trends.end())
+    {
+        return;
+    }
+
+    std::deque<History::Sample> &samples = trend->second;
+    if (!samples.empty() && timestamp < samples.back().timestamp + Setting::HISTORY::INTERVAL * 1000000ull)
+    {
+        return;
+    }
+
+    History::Sample sample{timestamp, {}};
+    memcpy(sample.payload, payload, BUFLEN);
+    samples.push_back(sample);
+
+    if (samples.size() > Setting::HISTORY::SECONDS * 1000 / Setting::HISTORY::INTERVAL)
+    {
+        samples.pop_front();
+    }
+}
+
+void COMService::record(uint32_t sequence, uint64_t timestamp, uint64_t received)
+{
+    if (clock.synchronized())
+    {
+        uint64_t sent{clock.toLocal(timestamp)};
+        receive_latency.add(static_cast<int64_t>(received - sent) / 1000);
+
+        frame_sent = sent;
+        frame_timestamp = timestamp;
+        frame_sequence = sequence;
+    }
+}
+
+uint32_t COMService::getLatency(double percentile)
+{
+    return std::max<int64_t>(0, receive_latency.percentile(percentile));
+}
+
+uint32_t COMService::getRenderLatency(double percentile)
+{
+    return std::max<int64_t>(0, render_latency.percentile(percentile));
+}
+
+void COMService::rendered(void)
+{
+    uint64_t sent{frame_sent};
+    uint32_t sequence{frame_sequence};
+
+    uint64_t timestamp{frame_timestamp};
+
+    // Every frame is only counted once, the render timer is faster than some senders
+    if (sent != 0 && sequence != rendered_sequence)
+    {
+        uint64_t now{Protocol::now()};
+
+        rendered_sequence = sequence;
+        render_latency.add(static_cast<int64_t>(now - sent) / 1000);
+
+        // The render time on the server clock, without touching the clock estimate from this thread.
+        std::vector<uint8_t> message;
+        Protocol::encode(Protocol::Ack{sequence, timestamp, timestamp + (now - sent)}, message);
+        transmit(message);
+    }
+}
+
+void COMService::subscribe(const std::vector<std::string> &signals)
+{
+    Protocol::Subscribe subscribe;
+    subscribe.signals.assign((signal.size() + 7) / 8, 0);
+
+    for (const auto &name : signals)
+    {
+        int index{signal.index(name)};
+        if (index >= 0)
+        {
+            subscribe.signals[index / 8] |= 1 << (index % 8);
+        }
+    }
+
+    std::vector<uint8_t> message;
+    Protocol::encode(subscribe, message);
+
+    {
+        std::scoped_lock lock(mtx);
+        subscription = subscribe.signals;
+    }
+    transmit(message);
+}
+
+void COMService::requestInterval(uint16_t interval)
+{
+    std::vector<uint8_t> message;
+    Protocol::encode(Protocol::Rate{interval}, message);
+
+    {
+        std::scoped_lock lock(mtx);
+        requested_interval = interval;
+    }
+    transmit(message);
+}
+
+void COMService::requestHistory(uint16_t seconds, uint16_t channel)
+{
+    std::vector<uint8_t> message;
+    Protocol::encode(Protocol::History{channel, seconds}, message);
+
+    {
+        std::scoped_lock lock(mtx);
+        requested_history = seconds;
+        trends[channel];
+    }
+    transmit(message);
+}
+
+std::vector<History::Sample> COMService::getHistory(uint16_t channel)
+{
+    std::scoped_lock lock(mtx);
+
+    auto trend = trends.find(channel);
+    if (trend == trends.end())
+    {
+        return {};
+    }
+    return {trend->second.begin(), trend->second.end()};
+}
+
+std::vector<uint8_t> COMService::control(void)
+{
+    std::vector<uint8_t> messages;
+    std::scoped_lock lock(mtx);
+
+    if (!subscription.empty())
+    {
+        Protocol::encode(Protocol::Subscribe{subscription}, messages);
+    }
+    if (requested_interval >= 0)
+    {
+        Protocol::encode(Protocol::Rate{static_cast<uint16_t>(requested_interval)}, messages);
+    }
+    if (requested_history >= 0)
+    {
+        for (const auto &[channel, trend] : trends)
+        {
+            Protocol::encode(Protocol::History{channel, static_cast<uint16_t>(requested_history)}, messages);
+        }
+    }
+
+    return messages;
+}
+
 void COMService::extract(uint32_t start, uint32_t length, uint32_t &value)
 {
     if (start >= 32 || length == 0 || (start + length > 32))
@@ -3,10 +3,39 @@
 #include <arpa/inet.h> 
 #include <unistd.h>     
 #include <cstring>
+#include <poll.h>
+#include <algorithm>
 #include "tcpservice.h"
 #include "comservice.h"
 
-constexpr int buffer_length = 3; // Setting::BUFLEN
+// Control messages are small, more than this pending means the server stopped reading.
+constexpr size_t OUTBOX_LIMIT{4096};
+
+void TCPClient::flush(void)
+{
+    while (!outbox.empty())
+    {
+        ssize_t bytes_written{send(sockfd, outbox.data(), outbox.size(), MSG_DONTWAIT | MSG_NOSIGNAL)};
+
+        if (bytes_written <= 0)
+        {
+            break; // Full or lost, the rest is written later or dropped on reconnect.
+        }
+        outbox.erase(outbox.begin(), outbox.begin() + bytes_written);
+    }
+}
+
+void TCPClient::transmit(const std::vector<uint8_t> &message)
+{
+    std::scoped_lock lock{tx_mtx};
+
+    if (status && outbox.size() + message.size() <= OUTBOX_LIMIT)
+    {
+        outbox.insert(outbox.end(), message.begin(), message.end());
+        last_transmit = Protocol::now();
+        flush();
+    }
+}
 
 void TCPClient::run(void)
 {
@@ -51,29 +80,109 @@ void TCPClient::run(void)
             }
         }
 
-        // Set status to true, indicating the connection is established.
-        status = true;
+        // A new connection can be a different server with a different clock.
+        clock.reset();
+        parser.reset();
 
+        {
+            std::scoped_lock lock{tx_mtx};
+            outbox.clear();
+
+            // Set status to true, indicating the connection is established.
+            status = true;
+        }
 
-        uint8_t _buffer[BUFLEN];         // Create a buffer to store received data
+        // Restore the subscription and rate on the new connection.
+        std::vector<uint8_t> requested{control()};
+        if (!requested.empty())
+        {
+            transmit(requested);
+        }
+
+        uint8_t _buffer[256];            // Create a buffer to store received data
         bzero(_buffer, sizeof(_buffer)); // Fill/initialize the buffer with zero.
 
+        uint64_t next_ping{Protocol::now()};
+
         // While the connection is active, we read data from the server.:
         while (status)
         {
+            // Ping the server regularly to keep the clock estimate up to date.
+            uint64_t now{Protocol::now()};
+            if (now >= next_ping)
+            {
+                std::vector<uint8_t> message;
+                Protocol::encode(Protocol::Ping{now}, message);
+                transmit(message); // A lost connection is detected by the read below.
+
+                next_ping = now + Setting::SYNC_INTERVAL * 1000000ull;
+            }
+
+            // Keep the session open while nothing else is sent, e.g. while the window is hidden.
+            uint64_t next_keepalive;
+            {
+                std::scoped_lock lock{tx_mtx};
+                flush(); // Anything the socket did not take earlier
+                next_keepalive = last_transmit + Setting::CONTROL::KEEPALIVE_INTERVAL * 1000000ull;
+            }
+            if (now >= next_keepalive)
+            {
+                std::vector<uint8_t> message;
+                Protocol::encode(Protocol::Keepalive{}, message);
+                transmit(message);
+                next_keepalive = now + Setting::CONTROL::KEEPALIVE_INTERVAL * 1000000ull;
+            }
+
+            // Wait for data until the next ping or keepalive is due.
+            uint64_t wakeup{std::min(next_ping, next_keepalive)};
+            pollfd pfd{sockfd, POLLIN, 0};
+            if (poll(&pfd, 1, static_cast<int>((wakeup - now) / 1000000) + 1) == 0)
+            {
+                continue;
+            }
 
             // READ INCOMING DATA.
             ssize_t bytes_read{-1};
             bytes_read = read(sockfd, _buffer, sizeof(_buffer));
 
 
-            // Copy the data to the COMService's buffer if bytes_read is greater than 0.
+            // Hand complete messages to COMService if bytes_read is greater than 0.
             if (bytes_read > 0)
             {
-                {
-                    std::scoped_lock lock{mtx};                                      // Lock the mutex to protect shared data
-                    memcpy(COMService::buffer, _buffer, sizeof(COMService::buffer)); // Copy the received data to COMService's buffer
-                }
+                parser.feed(_buffer, bytes_read, [this](Protocol::Type type, const uint8_t *payload, size_t length)
+                            {
+                    if (type == Protocol::Type::DATA)
+                    {
+                        Protocol::Data data;
+                        if (Protocol::decode(payload, length, data))
+                        {
+                            receive(data);
+                        }
+                    }
+                    else if (type == Protocol::Type::UPDATE)
+                    {
+                        Protocol::Update update;
+                        if (Protocol::decode(payload, length, update))
+                        {
+                            receive(update);
+                        }
+                    }
+                    else if (type == Protocol::Type::BACKFILL)
+                    {
+                        Protocol::Backfill backfill;
+                        if (Protocol::decode(payload, length, backfill))
+                        {
+                            receive(backfill);
+                        }
+                    }
+                    else if (type == Protocol::Type::PONG)
+                    {
+                        Protocol::Pong pong;
+                        if (Protocol::decode(payload, length, pong))
+                        {
+                            clock.add(pong, Protocol::now());
+                        }
+                    } });
             }
             else if (bytes_read == 0)
             {
@@ -82,8 +191,14 @@ void TCPClient::run(void)
                 // Reset the status and buffer, then close the socket.
                 // This is to ensure that the client can reconnect later.
 
-                status = false;
-                bzero(COMService::buffer, sizeof(COMService::buffer));
+                {
+                    std::scoped_lock lock{tx_mtx};
+                    status = false;
+                }
+                {
+                    std::scoped_lock lock{mtx};
+                    std::fill(channels.begin(), channels.end(), Channel{});
+                }
                 connect_check = -1;
                 close(sockfd);
 
@@ -0,0 +1,122 @@
+#include "setting.h"
+#include "uartservice.h"
+#include "usbserial.h"
+#include "serialport.h"
+#include "framing.h"
+#include "bridge.h"
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+// UARTService on termios2 instead of QSerialPort, selected with -DUART_BACKEND=TERMIOS.
+// One epoll loop waits for the port and hotplug events, the port polls readable once a whole frame is buffered.
+
+// Whether the port was unplugged, takes the pending hotplug events without waiting.
+static bool unplugged(Hotplug &hotplug, const std::string &portName)
+{
+    Hotplug::Event event;
+    bool removed{false};
+
+    while (hotplug.wait(0, event))
+    {
+        removed |= (event.action == Hotplug::Action::REMOVE && event.device == portName);
+    }
+    return removed;
+}
+
+void UARTService::run(void)
+{
+    SerialPort serial;
+    std::string client_ESP_serial_number;
+    std::string portName;
+
+    uint8_t chunk[4096];      // Read straight from the port into the decoder
+    uint8_t received[BUFLEN]; // Newest valid frame of a read, only that one is copied to the buffer under the lock.
+    framing_decoder_t decoder{};
+    int32_t newest{-1};       // seq of the newest frame through the ESP32 bridges, see bridge_overtaken()
+
+    int epfd{epoll_create1(EPOLL_CLOEXEC)};
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = hotplug.descriptor();
+    epoll_ctl(epfd, EPOLL_CTL_ADD, hotplug.descriptor(), &event);
+
+    while (!end)
+    {
+        if (!serial.isOpen())
+        {
+            // By the ESP32's USB serial number, it may come back as another tty after a replug.
+            portName = UsbSerial::locate(CLIENT_PORT, client_ESP_serial_number);
+            if (portName.empty() || !serial.open(portName, BAUDRATE, O_RDONLY, FRAMING_ENCODED_LEN(BUFLEN)))
+            {
+                // Until a tty is added, or a retry if it is there but not usable yet, e.g. udev is still setting the permissions.
+                Hotplug::Event plugged;
+                hotplug.wait(portName.empty() ? Setting::UART::RESCAN_INTERVAL : Setting::UART::RETRY_INTERVAL, plugged);
+                continue;
+            }
+
+            framing_reset(&decoder); // The bytes before the first delimiter are the tail of a frame
+            newest = -1;
+            event.data.fd = serial.descriptor();
+            epoll_ctl(epfd, EPOLL_CTL_ADD, serial.descriptor(), &event);
+        }
+
+        // Silence only marks the link down, the port stays open for the next frame.
+        epoll_event events[2];
+        int count{epoll_wait(epfd, events, 2, Setting::UART::LIVENESS_TIMEOUT)};
+
+        if (count == 0)
+        {
+            status = false;
+            newest = -1; // The server ESP32 may have restarted
+        }
+
+        for (int i = 0; i < count && serial.isOpen(); i++)
+        {
+            ssize_t length{0};
+            bool fresh{false};
+
+            if (events[i].data.fd == hotplug.descriptor())
+            {
+                // Reconnect as soon as the kernel reports the ESP32 gone, not when a read fails.
+                length = unplugged(hotplug, portName) ? -1 : 0;
+            }
+
+            // A damaged frame is dropped alone, the decoder resyncs on the next delimiter.
+            while (events[i].data.fd == serial.descriptor() && (length = serial.read(chunk, sizeof(chunk))) > 0)
+            {
+                for (ssize_t byte = 0; byte < length; byte++)
+                {
+                    int size{framing_feed(&decoder, chunk[byte])};
+
+                    // Through the ESP32 bridges a frame carries its seq, one an urgent frame overtook is older state.
+                    if (size == BUFLEN || (size == BRIDGE_TAGGED_LEN && !bridge_overtaken(decoder.data, &newest)))
+                    {
+                        memcpy(received, decoder.data, BUFLEN);
+                        fresh = true;
+                    }
+                }
+            }
+
+            if (fresh)
+            {
+                {
+                    std::scoped_lock lock(mtx);
+                    memcpy(channels[0].buffer, received, BUFLEN);
+                }
+                status = true;
+            }
+
+            if (length < 0)
+            {
+                status = false;
+                epoll_ctl(epfd, EPOLL_CTL_DEL, serial.descriptor(), nullptr);
+                serial.close();
+            }
+        }
+    }
+
+    close(epfd);
+}
@@ -1,191 +1,164 @@
 #include <QDebug>
 #include "setting.h"
+#include <QTimer>
 #include <QSerialPort>
-#include <QSerialPortInfo>
+#include <QSocketNotifier>
 #include "uartservice.h"
 #include <iostream>
-#include <QProcess>
+#include "usbserial.h"
+#include "framing.h"
+#include "bridge.h"
 
 // Find Relevant ID number via lsusb
 #define ESP32_PID 0xea60 // Product ID for ESP-C6
 
-// Retrieve the short serial number of a USB device associated with a given TTY port
-QString readSerialFromSys(const QString &portName)
+// Whether the port was unplugged, takes the pending hotplug events without waiting.
+static bool unplugged(Hotplug &hotplug, const std::string &portName)
 {
-    QString serialNumber{};
+    Hotplug::Event event;
+    bool removed{false};
 
-    QProcess process;
-    process.start("udevadm", QStringList() << "info" << "-q" << "all" << "-n" << portName);
-
-    if (!process.waitForFinished(1000)) // Wait up to 1 second
-    {
-        qDebug() << "udevadm timed out for port" << portName;
-    }
-
-    else
-    {
-        QString output = process.readAllStandardOutput();
-
-        // Extract the ID_SERIAL_SHORT line
-        for (const QString &line : output.split('\n'))
-        {
-            if (line.startsWith("E: ID_SERIAL_SHORT="))
-            {
-                serialNumber = line.section('=', 1);
-                break; // Stop as soon as we find it
-            }
-        }
-    }
-
-    return serialNumber;
-}
-
-QString findAvailablePort(const QString &espSN)
-{
-    QString port;
-
-    foreach (const QSerialPortInfo &info, QSerialPortInfo::availablePorts())
+    while (hotplug.wait(0, event))
     {
-        QString sysSN = readSerialFromSys(info.systemLocation());
-
-        if (sysSN == espSN) // SN match is enough
-        {
-            port = info.systemLocation();
-            break;
-        }
+        removed |= (event.action == Hotplug::Action::REMOVE && event.device == portName);
     }
-    return port;
+    return removed;
 }
 
 void UARTService::run(void)
 {
     QSerialPort serial;
-    QString client_ESP_serial_number{};
+    std::string client_ESP_serial_number;
+    std::string portName; // As located, /dev/ttyXXX like the hotplug events, QSerialPort::portName() drops the /dev/
 
-    QString portName{CLIENT_PORT};
-    serial.setPortName(portName);
+    serial.setPortName(CLIENT_PORT);
     serial.setBaudRate(BAUDRATE);
     serial.setDataBits(QSerialPort::Data8);
     serial.setParity(QSerialPort::NoParity);
     serial.setStopBits(QSerialPort::OneStop);
     serial.setFlowControl(QSerialPort::NoFlowControl);
 
-    uint8_t localBuffer[BUFLEN]; // Used to transmit the buffer values, minimising lock time on real buffer.
+    uint8_t chunk[4096];      // Read straight from the port into the decoder, no QByteArray in between
+    uint8_t received[BUFLEN]; // Newest valid frame of a read, only that one is copied to the buffer under the lock.
+    framing_decoder_t decoder{};
+    int32_t newest{-1};       // seq of the newest frame through the ESP32 bridges, see bridge_overtaken()
 
-    bool wasConnected{false}; // Track previous state
-    bool portErrorDisplayed{false};
-    bool SN_messageDisplayed{false};
+    // Everything below runs on this thread's event loop, nothing blocks on the port.
+    QSocketNotifier plug{hotplug.descriptor(), QSocketNotifier::Read};
+    QTimer rescan;   // Looks for the ESP32 again in case a hotplug event was missed
+    QTimer liveness; // Restarted by every valid frame, the link is down when it expires
+    rescan.setSingleShot(true);
+    liveness.setSingleShot(true);
 
-    while (!end)
+    auto closePort = [&]()
     {
-        if (client_ESP_serial_number.isEmpty())
-        {
-            if (!SN_messageDisplayed)
-            {
-                //Found ESP32 port
-                SN_messageDisplayed = true;
-            }
+        status = false;
+        serial.close();
+        liveness.stop();
+        rescan.start(Setting::UART::RESCAN_INTERVAL);
+    };
 
-            else // Represent retries as a progress bar
-            {
-                std::cout << "-" << std::flush;
-            }
-            client_ESP_serial_number = readSerialFromSys(CLIENT_PORT);
+    auto openPort = [&]()
+    {
+        if (serial.isOpen())
+        {
+            return;
         }
 
-        else
+        // By the ESP32's USB serial number, it may come back as another tty after a replug.
+        portName = UsbSerial::locate(CLIENT_PORT, client_ESP_serial_number);
+        if (portName.empty())
         {
-            break;
+            rescan.start(Setting::UART::RESCAN_INTERVAL);
+            return;
         }
-        msleep(500);
-    }
 
-    while (!end)
-    {
-        // Ensure port is open
-        if (portName.isEmpty() || !serial.isOpen())
+        serial.setPortName(QString::fromStdString(portName));
+        if (!serial.open(QIODevice::ReadOnly))
         {
-            if (!serial.open(QIODevice::ReadOnly))
-            {
-                if (wasConnected) // Only log once when losing connection
-                {
-                    wasConnected = false;
-                }
-                msleep(500); // Retry every 0.5s
+            // Plugged in but not usable yet, e.g. udev is still setting the permissions.
+            rescan.start(Setting::UART::RETRY_INTERVAL);
+            return;
+        }
 
-                portName = findAvailablePort(client_ESP_serial_number);
-                if (portName.isEmpty())
-                {
+        framing_reset(&decoder); // The bytes before the first delimiter are the tail of a frame
+        newest = -1;
+        liveness.start(Setting::UART::LIVENESS_TIMEOUT);
+    };
 
-                    if (!portErrorDisplayed)
-                    {
-                        portErrorDisplayed = true;
-                    }
+    QObject::connect(&serial, &QSerialPort::readyRead, &serial, [&]()
+                     {
+        bool fresh{false};
+        qint64 length;
 
-                    continue;
-                }
+        // A damaged frame is dropped alone, the decoder resyncs on the next delimiter.
+        while ((length = serial.read(reinterpret_cast<char *>(chunk), sizeof(chunk))) > 0)
+        {
+            for (qint64 i = 0; i < length; i++)
+            {
+                int size{framing_feed(&decoder, chunk[i])};
 
-                else
+                // Through the ESP32 bridges a frame carries its seq, one an urgent frame overtook is older state.
+                if (size == BUFLEN || (size == BRIDGE_TAGGED_LEN && !bridge_overtaken(decoder.data, &newest)))
                 {
-                    serial.setPortName(portName);
-                    portErrorDisplayed = false;
+                    memcpy(received, decoder.data, BUFLEN);
+                    fresh = true;
                 }
             }
-
-            continue;
-        }
-        else
-        {
-            status = true;
-            wasConnected = true;
         }
 
-        while (!end)
+        if (fresh)
         {
-            if (serial.waitForReadyRead(100)) // Wait up to 100ms
             {
-                status = true;
-
-                while (serial.bytesAvailable() >= 3)
-                {
-                    QByteArray data = serial.readAll();
-
-                    // Check packet alignment
-                    if (data.size() % 3 != 0)
-                    {
-                        qWarning() << "UART misaligned: got" << data.size() << "bytes, clearing buffer";
-                        serial.clear(QSerialPort::Input);
-                        break; // breaks inner while loop, outer loop continues
-                    }
-
-                    // Process in 3-byte chunks
-                    for (int i = 0; i < data.size(); i += 3)
-                    {
-                        uint8_t localBuffer[3];
-                        memcpy(localBuffer, data.constData() + i, 3);
-                        {
-                            std::scoped_lock lock(mtx);
-                            memcpy(buffer, localBuffer, 3);
-                        }
-                    }
-                }
+                std::scoped_lock lock(mtx);
+                memcpy(channels[0].buffer, received, BUFLEN);
             }
-            else
-            {
-                status = false;
+            status = true;
+            liveness.start(Setting::UART::LIVENESS_TIMEOUT);
+        } });
 
-                // Timeout occurred; check for port errors
-                if (serial.error() == QSerialPort::TimeoutError)
-                {
-                    // Transient timeout, try again
-                    continue;
-                }
-                else
-                {
-                    serial.close();
-                    break; // Exit outer loop to trigger reconnection logic
-                }
-            }
+    QObject::connect(&serial, &QSerialPort::errorOccurred, &serial, [&](QSerialPort::SerialPortError error)
+                     {
+        if (error == QSerialPort::ResourceError && serial.isOpen())
+        {
+            closePort();
+        } });
+
+    // Silence only marks the link down, the port stays open for the next frame.
+    QObject::connect(&liveness, &QTimer::timeout, &serial, [&]()
+                     {
+        status = false;
+        newest = -1; // The server ESP32 may have restarted
+    });
+    QObject::connect(&rescan, &QTimer::timeout, &serial, openPort);
+
+    QObject::connect(&plug, &QSocketNotifier::activated, &serial, [&]()
+                     {
+        // Reconnect as soon as the kernel reports the ESP32 gone, and look for it when a tty is added.
+        bool removed{unplugged(hotplug, portName)};
+
+        if (end)
+        {
+            exit();
+        }
+        else if (removed && serial.isOpen())
+        {
+            closePort();
         }
+        else if (!serial.isOpen())
+        {
+            openPort();
+        }
+        else
+        {
+            ;
+        } });
+
+    openPort();
+
+    if (!end)
+    {
+        exec(); // Until the destructor's hotplug.wake()
     }
+    serial.close();
 }
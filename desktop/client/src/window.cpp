@@ -34,10 +34,17 @@ Window::Window(COMService &com_service) : canvas(this) // Initialize canvas with
                          canvas.indicator_set_right(com_service.getRightLight());
 
                          canvas.update(); // Request a repaint
+                         com_service.rendered();
+
+                         // Glass-to-glass latency of the frames shown so far
+                         canvas.connection_set_latency(com_service.getRenderLatency(50), com_service.getRenderLatency(99));
                      });
 
     update_timer.start(Setting::INTERVAL);
 
+    // Frames arriving faster than the window renders would only be dropped.
+    com_service.requestInterval(Setting::INTERVAL);
+
     // Create the canvas and add it to the layout
     layout.addWidget(&canvas);
 }
\ No newline at end of file
@@ -0,0 +1,229 @@
+#ifndef BROADCASTER_H
+#define BROADCASTER_H
+
+#include <map>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include "protocol.h"
+#include "websocket.h"
+#include "statistics.h"
+
+/**
+ * @brief Non-blocking TCP fan-out of serialized frames to many clients, driven by the owner's epoll loop
+ *
+ * A frame is serialized once and shared by every session. Data frames are conflated per session:
+ * an unsent frame is replaced by a newer one carrying at least the same signals, so a client that
+ * cannot keep up gets the newest values instead of a growing backlog and never delays the others.
+ * A session that missed an update (rate limit, backlog) gets a keyframe with all signals next.
+ * A frame can hold one message per channel, its signal bitmap then covers all of them.
+ *
+ * Every session has a queue per Setting::Priority and the most urgent one is written first, so an
+ * urgent frame only ever waits for the one frame that is partly written. The kernel is only given
+ * a little unsent data at a time, the backlog stays in these queues where the order can change.
+ * Keyframes and replies go into the URGENT queue.
+ *
+ * A session with a subscription gets a view of every frame with just its signals, and nothing when a
+ * frame carries none of them. The view is serialized once per broadcast for all sessions with the
+ * same subscription, its keyframe is an UPDATE with all subscribed signals.
+ *
+ * Clients can send control messages on the same connection. RATE, SUBSCRIBE and KEEPALIVE are
+ * applied to the session's Control here, every message is then passed on to the Handler.
+ */
+class Broadcaster
+{
+public:
+    enum class Framing
+    {
+        STREAM,    // Protocol messages directly on the TCP stream
+        WEBSOCKET, // Protocol messages as binary WebSocket frames, for browsers
+    };
+
+    using Frame = std::shared_ptr<const std::vector<uint8_t>>;
+    using Signals = std::shared_ptr<const std::vector<uint8_t>>; // What a frame carries, see Protocol::cover(), nullptr = all signals
+    using Keyframe = std::function<Frame(void)>;
+
+    /**
+     * @brief Called for every complete message a client sends
+     *
+     * @param session  Identifies the client in send()
+     * @param type     Message type from the header
+     * @param payload  Start of the payload
+     * @param length   Payload length
+     * @param received Protocol::now() when the bytes were read
+     */
+    using Handler = std::function<void(int session, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received)>;
+
+    /**
+     * @brief What a client asked for with its control messages
+     *
+     */
+    struct Control
+    {
+        uint64_t requested{0};             // Interval from the client's RATE in ns, 0 = every frame
+        uint64_t interval{0};              // Interval in use, the owner may back off above requested
+        uint64_t next_due{0};              // Protocol::now() from which the next data frame is sent
+        uint64_t heard{0};                 // When the client last sent a message, 0 = never
+        int64_t latency{0};                // Smoothed render latency from the client's ACKs in us, owner-maintained
+        std::vector<uint8_t> subscription; // Bitmap from the client's SUBSCRIBE, empty = all signals
+    };
+
+private:
+    struct Pending
+    {
+        Frame frame;
+        bool conflate;   // Data frames can be replaced by a newer one before they are started
+        Signals signals; // What a data frame carries, a newer frame replaces it if it carries at least the same
+        Setting::Priority priority;
+        uint64_t queued; // Protocol::now() when it was queued
+    };
+
+    // A frame narrowed down to one subscription.
+    struct View
+    {
+        Frame frame;                // Wrapped, nullptr if the frame carries none of the subscribed signals
+        Signals signals;            // Subscribed signals in the frame, nullptr for a keyframe
+        Setting::Priority priority; // Most urgent of those signals
+        Frame keyframe;             // Wrapped keyframe of the subscription, built when a session needs it
+    };
+
+    struct Session
+    {
+        Protocol::Parser parser;
+        std::deque<Pending> lanes[Setting::PRIORITIES];
+        Pending writing{};     // Taken from a lane, frame is nullptr between frames
+        size_t offset{0};      // Bytes of writing already written
+        bool writable{true};   // false while waiting for EPOLLOUT
+        bool armed{false};     // EPOLLOUT is registered
+        bool upgraded{false};  // WebSocket handshake completed, always true for STREAM
+        bool stale{true};      // Missed an update or never got a keyframe, the next data frame must be one
+        bool closed{false};    // Dropped while being read, closed and erased once the read returns
+        bool closing{false};   // Answered a WebSocket Close, nothing more is queued and it is dropped once flushed
+        std::string request;   // WebSocket upgrade request received so far
+        WebSocket::Parser websocket;
+        Control control;
+    };
+
+    int port;
+    Framing framing;
+    int epfd{-1};
+    int listenfd{-1};
+    Handler handler;
+    std::unordered_map<int, Session> sessions;
+    int reading{-1}; // Session whose messages are being dispatched, drop() only marks it closed
+    Histogram delays[Setting::PRIORITIES];
+
+    void accept_sessions(void);
+    void read_session(int fd, Session &session);
+    void receive(int fd, Session &session, const uint8_t *data, size_t length, uint64_t received);
+    void upgrade(int fd, Session &session, const uint8_t *data, size_t length, uint64_t received);
+    Frame wrap(const Frame &frame) const;
+    View select(const Frame &frame, const std::vector<uint8_t> &subscription) const;
+    void flush(int fd, Session &session);
+    void drop(int fd);
+    void enqueue(int fd, Session &session, const Frame &frame, bool conflate, Setting::Priority priority, const Signals &signals = nullptr);
+    void apply(Control &control, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received);
+
+public:
+    /**
+     * @brief Constructor for Broadcaster object
+     *
+     * @param port    TCP port to listen on
+     * @param handler Receives the messages sent by clients, may be empty
+     * @param framing How messages are framed on the connection
+     */
+    Broadcaster(int port, Handler handler = {}, Framing framing = Framing::STREAM)
+        : port{port}, framing{framing}, handler{std::move(handler)} {}
+
+    /**
+     * @brief Destructor for Broadcaster object, closes all sessions
+     *
+     */
+    ~Broadcaster();
+
+    Broadcaster(const Broadcaster &) = delete;
+    Broadcaster &operator=(const Broadcaster &) = delete;
+
+    /**
+     * @brief Start listening and register the socket with an epoll instance
+     *
+     * @param epoll The owner's epoll file descriptor
+     * @return true if listening, false if the port could not be bound yet (retry later)
+     */
+    bool attach(int epoll);
+
+    /**
+     * @brief Handle an epoll event
+     *
+     * @param fd     The file descriptor from the event
+     * @param events The event mask
+     * @return true if the file descriptor belongs to this broadcaster
+     */
+    bool handle(int fd, uint32_t events);
+
+    /**
+     * @brief Send a keyframe with all signals to every session that is due
+     *
+     * Sessions with a Control::interval skip frames until their next frame is due.
+     *
+     * @param frame The serialized frame
+     */
+    void broadcast(const Frame &frame);
+
+    /**
+     * @brief Send an update of some signals to every session that is due
+     *
+     * Sessions that are stale get the keyframe instead, it is only built if one needs it.
+     * The update is queued with the most urgent priority of its signals.
+     *
+     * @param frame    The serialized update, or updates of several channels
+     * @param signals  Bitmap of the signals of all channels in the frame, see Protocol::cover()
+     * @param keyframe Builds the serialized keyframe with all signals of all channels
+     */
+    void broadcast(const Frame &frame, const Signals &signals, const Keyframe &keyframe);
+
+    /**
+     * @brief Send a frame to one session without conflation and ahead of data frames, e.g. a reply
+     *
+     * @param session The session from the Handler
+     * @param frame   The serialized frame
+     */
+    void send(int session, const Frame &frame);
+
+    /**
+     * @brief Get the control state of a session
+     *
+     * @param session The session from the Handler
+     * @return The session's control state, nullptr if the session is gone
+     */
+    Control *control(int session);
+
+    /**
+     * @brief Close sessions that stopped sending, clients that never sent anything are kept
+     *
+     * @param now     Protocol::now()
+     * @param timeout Nanoseconds of silence after which a session is closed
+     */
+    void expire(uint64_t now, uint64_t timeout);
+
+    /**
+     * @brief Get how long frames of a priority waited in the queues until they were written to the socket
+     *
+     * @param priority The queue
+     * @return Delays in microseconds, max() is the worst case
+     */
+    const Histogram &delay(Setting::Priority priority) const { return delays[priority]; }
+
+    /**
+     * @brief Get the number of connected clients
+     *
+     * @return Number of sessions
+     */
+    size_t size(void) const { return sessions.size(); }
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <cstddef>
+#include <cstdint>
+#include "protocol.h"
+
+/**
+ * @brief NTP-style estimate of the offset and drift between the server clock and the local clock
+ *
+ * Every ping/pong exchange gives one sample of the offset together with the round trip delay.
+ * Samples with a short round trip are the most accurate ones, so the offset is taken from the
+ * best recent sample and the drift from a line fitted through the low-delay samples.
+ */
+class ClockSync
+{
+    struct Sample
+    {
+        uint64_t local; // Local clock at the middle of the exchange
+        int64_t offset; // Server clock minus local clock
+        int64_t delay;  // Round trip minus the server's processing time
+    };
+
+    static constexpr size_t WINDOW{32}; // Samples kept for the drift fit
+    static constexpr size_t FILTER{8};  // Most recent samples the offset is picked from
+
+    Sample samples[WINDOW]{};
+    size_t count{0};
+    size_t next{0};
+
+    Sample best{};
+    double drift{0.0}; // Change of offset per local nanosecond
+
+    /**
+     * @brief Recompute the best sample and the drift after a new sample arrived
+     *
+     */
+    void estimate(void);
+
+public:
+    /**
+     * @brief Add the result of one ping/pong exchange
+     *
+     * @param pong     The reply from the server
+     * @param received Local clock when the pong arrived
+     */
+    void add(const Protocol::Pong &pong, uint64_t received);
+
+    /**
+     * @brief Check whether at least one exchange completed
+     *
+     * @return true if toLocal() can be used
+     */
+    bool synchronized(void) const { return count > 0; }
+
+    /**
+     * @brief Convert a server timestamp to the local clock
+     *
+     * @param server Server clock value, e.g. Protocol::Data::timestamp
+     * @return The same instant on the local clock
+     */
+    uint64_t toLocal(uint64_t server) const;
+
+    /**
+     * @brief Convert a local timestamp to the server clock
+     *
+     * @param local Local clock value, e.g. Protocol::now()
+     * @return The same instant on the server clock
+     */
+    uint64_t toServer(uint64_t local) const;
+
+    /**
+     * @brief Get the estimated drift between the clocks
+     *
+     * @return Drift in parts per million
+     */
+    double driftPpm(void) const { return drift * 1e6; }
+
+    /**
+     * @brief Forget all samples, e.g. after a reconnect to a different server
+     *
+     */
+    void reset(void);
+};
+
+#endif
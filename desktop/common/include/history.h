@@ -0,0 +1,78 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "protocol.h"
+
+/**
+ * @brief Fixed-memory ring of the recent signal buffers of all channels, sampled at a fixed interval
+ *
+ * All memory is allocated up front, a new sample overwrites the oldest. The samples of one channel
+ * are sent as BACKFILL messages: every buffer is XORed with the one before it, so the signals that
+ * did not change become zero bytes, and the runs of zeros are then run-length encoded.
+ */
+class History
+{
+public:
+    struct Sample
+    {
+        uint64_t timestamp;      // Server clock, see Protocol::now()
+        uint8_t payload[BUFLEN]; // The packed signals, see SIGNAL_LIST
+    };
+
+private:
+    size_t channels;
+    size_t capacity;
+    uint64_t interval;               // ns between samples
+    std::vector<uint64_t> timestamps; // One per slot
+    std::vector<uint8_t> payloads;   // Slot-major, channels * BUFLEN bytes per slot
+    size_t next{0};                  // Slot the next sample goes into
+    size_t count{0};                 // Slots in use
+
+public:
+    /**
+     * @brief Constructor for History object
+     *
+     * @param channels Number of channels in every sample
+     * @param capacity Number of samples kept
+     * @param interval Time between samples in ns, as taken by the owner
+     */
+    History(size_t channels, size_t capacity, uint64_t interval);
+
+    /**
+     * @brief Start a new sample, overwriting the oldest one if the ring is full
+     *
+     * @param timestamp Protocol::now() of the sample
+     * @return channels * BUFLEN bytes for the owner to fill, channel after channel
+     */
+    uint8_t *push(uint64_t timestamp);
+
+    /**
+     * @brief Serialize the samples of one channel as BACKFILL messages, oldest first
+     *
+     * @param channel The channel
+     * @param since   Protocol::now() value, older samples are left out
+     * @param out     The framed messages are appended here, nothing if there are no samples
+     */
+    void backfill(uint16_t channel, uint64_t since, std::vector<uint8_t> &out) const;
+
+    /**
+     * @brief Decompress the samples of a BACKFILL message
+     *
+     * @param backfill The received message
+     * @param samples  The samples are appended here, oldest first
+     * @return false if the message is corrupt, samples is then unchanged
+     */
+    static bool expand(const Protocol::Backfill &backfill, std::vector<Sample> &samples);
+
+    /**
+     * @brief Get the number of samples kept
+     *
+     * @return Samples in the ring
+     */
+    size_t size(void) const { return count; }
+};
+
+#endif
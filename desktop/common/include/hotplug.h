@@ -0,0 +1,115 @@
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+
+/**
+ * @brief Kernel hotplug events (uevents) of one subsystem, read from a netlink socket
+ *
+ * A thread that waits for a device blocks in wait() and wakes up as soon as the kernel adds or
+ * removes one, instead of polling. Synthetic uevents can be injected, they take the same path as
+ * the ones from the kernel. Without netlink (e.g. in a container) only injected events arrive and
+ * wait() runs into its timeout, so callers keep a slow rescan as a fallback. An event loop watches
+ * descriptor() instead of blocking in wait().
+ */
+class Hotplug
+{
+public:
+    enum class Action
+    {
+        ADD,
+        REMOVE,
+        OTHER, // change, bind, unbind, ...
+    };
+
+    struct Event
+    {
+        Action action;
+        std::string subsystem; // e.g. tty
+        std::string device;    // Device node, e.g. /dev/ttyACM0, empty if the device has none
+    };
+
+private:
+    std::string subsystem;
+    int netlink{-1};
+    int injected[2]{-1, -1}; // Datagram socket pair, inject() writes to the second one
+    int poller{-1};          // epoll set of netlink and injected[0]
+    std::atomic<bool> woken{false};
+
+    /**
+     * @brief Read one pending datagram from a socket
+     *
+     * @param fd    The socket
+     * @param event Filled in if the datagram is an event of the subsystem
+     * @return true if event was filled in
+     */
+    bool receive(int fd, Event &event);
+
+public:
+    /**
+     * @brief Constructor for Hotplug object, subscribes to the kernel's uevents
+     *
+     * @param subsystem Only events of this subsystem are reported
+     */
+    explicit Hotplug(const std::string &subsystem = "tty");
+
+    /**
+     * @brief Destructor for Hotplug object
+     *
+     */
+    ~Hotplug();
+
+    Hotplug(const Hotplug &) = delete;
+    Hotplug &operator=(const Hotplug &) = delete;
+
+    /**
+     * @brief Wait for the next event of the subsystem
+     *
+     * @param timeout Milliseconds to wait at most, 0 only takes an event that is already pending
+     * @param event   Filled in on success
+     * @return false on timeout or after wake()
+     */
+    bool wait(int timeout, Event &event);
+
+    /**
+     * @brief Make a wait() in another thread return false right away, e.g. to stop that thread.
+     *        descriptor() becomes readable as well.
+     *
+     */
+    void wake(void);
+
+    /**
+     * @brief Feed a synthetic uevent as if it came from the kernel, e.g. for testing
+     *
+     * @param uevent "ACTION@DEVPATH" followed by KEY=VALUE entries, all NUL-terminated
+     */
+    void inject(const std::string &uevent);
+
+    /**
+     * @brief Whether kernel events arrive, false if the netlink socket could not be opened
+     *
+     * @return true if subscribed to the kernel
+     */
+    bool listening(void) const { return netlink >= 0; }
+
+    /**
+     * @brief Get a descriptor that is readable while an event or a wake() is pending, e.g. for a QSocketNotifier
+     *
+     * @return File descriptor, take the events with wait(0, ...) until it returns false
+     */
+    int descriptor(void) const { return poller; }
+
+    /**
+     * @brief Parse a uevent datagram
+     *
+     * @param message The datagram
+     * @param length  Its length
+     * @param event   Filled in on success
+     * @return false if it is not a kernel uevent, e.g. a udev message
+     */
+    static bool parse(const char *message, size_t length, Event &event);
+};
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "setting.h"
+
+// Every message on a stream transport is framed as:
+// [type: 1 byte][payload length: 2 bytes little-endian][payload]
+// All multi-byte fields in the payloads are little-endian.
+
+namespace Protocol
+{
+    enum class Type : uint8_t
+    {
+        DATA = 1, // Server -> client: a timestamped copy of the signal buffer
+        PING = 2, // Client -> server: clock synchronization request
+        PONG = 3, // Server -> client: clock synchronization reply
+        SUBSCRIBE = 4, // Client -> server: the signals the client wants to receive
+        RATE = 5,      // Client -> server: requested interval between data frames
+        ACK = 6,       // Client -> server: a data frame was rendered
+        KEEPALIVE = 7, // Client -> server: no payload, keeps an otherwise idle session open
+        UPDATE = 8,    // Server -> client: new values of some of the signals
+        HISTORY = 9,   // Client -> server: request the recent history of a channel
+        BACKFILL = 10, // Server -> client: compressed samples of the history, before the live frames
+    };
+
+    constexpr size_t HEADER_LEN{3};
+
+    struct Data
+    {
+        uint32_t sequence;        // Incremented by one for every frame the server sends
+        uint64_t timestamp;       // Server clock when the frame was sent, see now()
+        uint8_t hops;             // Number of relays the frame passed through
+        uint16_t channel;         // Vehicle the signals belong to, see Setting::CHANNELS
+        uint8_t payload[BUFLEN]; // The packed signals, see SIGNAL_LIST
+    };
+
+    struct Update
+    {
+        uint32_t sequence;            // Shares the counter with Data
+        uint64_t timestamp;           // Server clock when the frame was sent, see now()
+        uint8_t hops;                 // Number of relays the frame passed through
+        uint16_t channel;             // Vehicle the signals belong to, see Setting::CHANNELS
+        std::vector<uint8_t> signals; // Bitmap in SIGNAL_LIST order of the signals in values
+        std::vector<uint8_t> values;  // The values of those signals in index order, bit-packed without gaps
+    };
+
+    struct Ping
+    {
+        uint64_t origin; // Client clock when the ping was sent
+    };
+
+    struct Pong
+    {
+        uint64_t origin;   // Copied from the ping
+        uint64_t receive;  // Server clock when the ping arrived
+        uint64_t transmit; // Server clock when the pong was sent
+    };
+
+    struct Subscribe
+    {
+        std::vector<uint8_t> signals; // Bitmap in SIGNAL_LIST order, bit i is in byte i / 8; empty = all signals
+    };
+
+    struct Rate
+    {
+        uint16_t interval; // Milliseconds between data frames, 0 = every frame the server sends
+    };
+
+    struct Ack
+    {
+        uint32_t sequence; // Sequence of the rendered frame
+        uint64_t sent;     // Copied from the frame's timestamp
+        uint64_t rendered; // Server clock when the frame was shown
+    };
+
+    struct Keepalive
+    {
+    };
+
+    struct History
+    {
+        uint16_t channel; // Vehicle to send the history of
+        uint16_t seconds; // How far back, the server sends what it has up to Setting::HISTORY::SECONDS
+    };
+
+    struct Backfill
+    {
+        uint16_t channel;             // Vehicle the samples belong to
+        uint64_t timestamp;           // Server clock of the first sample, see now()
+        uint32_t interval;            // Microseconds between the samples
+        uint16_t count;               // Number of samples
+        std::vector<uint8_t> samples; // count packed signal buffers, compressed, see History
+    };
+
+    /**
+     * @brief Monotonic clock used for all protocol timestamps
+     *
+     * @return Nanoseconds since an arbitrary, per-host epoch
+     */
+    uint64_t now(void);
+
+    /**
+     * @brief Fill in update.values from a signal buffer
+     *
+     * @param buffer  The packed signals, see SIGNAL_LIST
+     * @param update  update.signals selects the signals to copy
+     */
+    void pack(const uint8_t *buffer, Update &update);
+
+    /**
+     * @brief Write the values of an update into a signal buffer, the other signals are kept
+     *
+     * @param update The received update
+     * @param buffer The packed signals, see SIGNAL_LIST
+     */
+    void apply(const Update &update, uint8_t *buffer);
+
+    /**
+     * @brief Narrow an update down to the signals a client subscribed to
+     *
+     * @param update       The update with all signals that changed
+     * @param subscription Signal bitmap, see Protocol::Subscribe
+     * @return The update with the signals in both bitmaps, no bit set if none of them changed
+     */
+    Update select(const Update &update, const std::vector<uint8_t> &subscription);
+
+    /**
+     * @brief Turn a keyframe into an update with just the signals a client subscribed to
+     *
+     * @param data         The keyframe
+     * @param subscription Signal bitmap, see Protocol::Subscribe
+     * @return An update with the sequence, timestamp, hops and channel of the keyframe
+     */
+    Update select(const Data &data, const std::vector<uint8_t> &subscription);
+
+    /**
+     * @brief Mark the signals of one channel in a bitmap over all channels
+     *
+     * Bit channel * signals + index stands for one signal of one channel. With a single channel
+     * this is the same as the signal bitmap.
+     *
+     * @param coverage Bitmap over all channels, grown as needed
+     * @param channel  The channel
+     * @param signals  Signal bitmap of the channel, see Protocol::Update
+     */
+    void cover(std::vector<uint8_t> &coverage, uint16_t channel, const std::vector<uint8_t> &signals);
+
+    /**
+     * @brief Get the priority a frame with these signals is sent with
+     *
+     * @param signals Signal bitmap, or a bitmap over all channels, see cover()
+     * @return The most urgent priority of the signals in the bitmap, URGENT for an empty bitmap (all signals)
+     */
+    Setting::Priority priority(const std::vector<uint8_t> &signals);
+
+    /**
+     * @brief Append a framed message to a byte stream
+     *
+     * @param message The message to serialize
+     * @param out     Bytes are appended to the end of this vector
+     */
+    void encode(const Data &message, std::vector<uint8_t> &out);
+    void encode(const Update &message, std::vector<uint8_t> &out);
+    void encode(const Ping &message, std::vector<uint8_t> &out);
+    void encode(const Pong &message, std::vector<uint8_t> &out);
+    void encode(const Subscribe &message, std::vector<uint8_t> &out);
+    void encode(const Rate &message, std::vector<uint8_t> &out);
+    void encode(const Ack &message, std::vector<uint8_t> &out);
+    void encode(const Keepalive &message, std::vector<uint8_t> &out);
+    void encode(const History &message, std::vector<uint8_t> &out);
+    void encode(const Backfill &message, std::vector<uint8_t> &out);
+
+    /**
+     * @brief Deserialize the payload of a framed message
+     *
+     * @param payload Start of the payload (after the header)
+     * @param length  Payload length from the header
+     * @param message Filled in on success
+     * @return true if the payload was long enough for the message
+     */
+    bool decode(const uint8_t *payload, size_t length, Data &message);
+    bool decode(const uint8_t *payload, size_t length, Update &message);
+    bool decode(const uint8_t *payload, size_t length, Ping &message);
+    bool decode(const uint8_t *payload, size_t length, Pong &message);
+    bool decode(const uint8_t *payload, size_t length, Subscribe &message);
+    bool decode(const uint8_t *payload, size_t length, Rate &message);
+    bool decode(const uint8_t *payload, size_t length, Ack &message);
+    bool decode(const uint8_t *payload, size_t length, History &message);
+    bool decode(const uint8_t *payload, size_t length, Backfill &message);
+
+    /**
+     * @brief Reassembles framed messages from a byte stream that can be split anywhere
+     *
+     */
+    class Parser
+    {
+        std::vector<uint8_t> pending;
+
+    public:
+        /**
+         * @brief Consume received bytes and report every complete message
+         *
+         * @param data     Received bytes
+         * @param length   Number of received bytes
+         * @param callback Called as callback(Type, const uint8_t *payload, size_t length)
+         */
+        template <typename Callback>
+        void feed(const uint8_t *data, size_t length, Callback &&callback)
+        {
+            pending.insert(pending.end(), data, data + length);
+
+            size_t offset{0};
+            while (pending.size() - offset >= HEADER_LEN)
+            {
+                const uint8_t *header{pending.data() + offset};
+                size_t payload_length{static_cast<size_t>(header[1] | (header[2] << 8))};
+
+                if (pending.size() - offset < HEADER_LEN + payload_length)
+                {
+                    break; // Wait for the rest of the message
+                }
+
+                callback(static_cast<Type>(header[0]), header + HEADER_LEN, payload_length);
+                offset += HEADER_LEN + payload_length;
+            }
+
+            pending.erase(pending.begin(), pending.begin() + offset);
+        }
+
+        /**
+         * @brief Drop a partially received message, e.g. after a reconnect
+         *
+         */
+        void reset(void) { pending.clear(); }
+    };
+}
+
+#endif
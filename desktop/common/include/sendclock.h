@@ -0,0 +1,97 @@
+#ifndef SENDCLOCK_H
+#define SENDCLOCK_H
+
+#include <cstdint>
+#include "statistics.h"
+
+/**
+ * @brief Wakes a send loop at absolute deadlines on the monotonic clock and records how late each send was
+ *
+ * The deadlines come from a timerfd, so neither the time spent writing nor a late wakeup shifts the
+ * following deadlines. The timer can be waited on directly or added to an epoll set.
+ */
+class SendClock
+{
+    int timerfd{-1};
+    uint64_t due{0};
+    uint64_t intended{0}; // The deadline that expired last, sent() is measured against it
+
+public:
+    /**
+     * @brief Send time minus intended time of every send, in microseconds
+     *
+     */
+    Histogram jitter;
+
+    /**
+     * @brief Constructor for SendClock object
+     *
+     */
+    SendClock();
+
+    /**
+     * @brief Destructor for SendClock object
+     *
+     */
+    ~SendClock();
+
+    SendClock(const SendClock &) = delete;
+    SendClock &operator=(const SendClock &) = delete;
+
+    /**
+     * @brief Set the next deadline
+     *
+     * @param deadline Absolute Protocol::now() value, a deadline in the past fires right away
+     */
+    void arm(uint64_t deadline);
+
+    /**
+     * @brief Arm one period after the current deadline, skipping periods that were missed completely
+     *
+     * @param period Period in ns
+     */
+    void advance(uint64_t period);
+
+    /**
+     * @brief Get the deadline set with arm()
+     *
+     * @return Absolute Protocol::now() value
+     */
+    uint64_t deadline(void) const { return due; }
+
+    /**
+     * @brief Get the timer file descriptor, readable once the deadline passed
+     *
+     * @return File descriptor to add to an epoll set with EPOLLIN
+     */
+    int descriptor(void) const { return timerfd; }
+
+    /**
+     * @brief Acknowledge an expiry after the descriptor became readable
+     *
+     * @return true if the deadline passed
+     */
+    bool expired(void);
+
+    /**
+     * @brief Block until the deadline
+     *
+     */
+    void wait(void);
+
+    /**
+     * @brief Record that the frame for the deadline that expired last went out just now
+     *
+     */
+    void sent(void);
+
+    /**
+     * @brief Ask for SCHED_FIFO for the calling thread
+     *
+     * @param priority Real-time priority 1 - 99, 0 leaves the thread's scheduling unchanged
+     * @return true if applied, false without the privilege (CAP_SYS_NICE or an rtprio limit)
+     */
+    static bool realtime(int priority);
+};
+
+#endif
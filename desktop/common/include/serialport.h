@@ -0,0 +1,95 @@
+#ifndef SERIALPORT_H
+#define SERIALPORT_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+/**
+ * @brief A tty opened raw and non-blocking through termios2, the native alternative to QSerialPort
+ *
+ * termios2 sets any baud rate, e.g. BAUDRATE, which is not one of the standard ones. VMIN sets how
+ * many bytes must be buffered before the descriptor polls readable, so an epoll loop is woken once
+ * per frame instead of once per byte. Where the driver supports it (FTDI, CP210x, 8250) the port is
+ * switched to ASYNC_LOW_LATENCY, which e.g. lowers the FTDI latency timer from 16 ms to 1 ms.
+ */
+class SerialPort
+{
+    int fd{-1};
+    bool low_latency{false};
+
+public:
+    /**
+     * @brief Constructor for SerialPort object, the port starts closed
+     *
+     */
+    SerialPort() = default;
+
+    /**
+     * @brief Destructor for SerialPort object
+     *
+     */
+    ~SerialPort();
+
+    SerialPort(const SerialPort &) = delete;
+    SerialPort &operator=(const SerialPort &) = delete;
+
+    /**
+     * @brief Open a tty, closing the one that was open
+     *
+     * @param device   Device node, e.g. /dev/ttyUSB0
+     * @param baudrate Bits per second, any rate the driver accepts
+     * @param mode     O_RDONLY, O_WRONLY or O_RDWR
+     * @param vmin     Bytes that must be buffered before the port polls readable, e.g. the size of a frame
+     * @return true if open
+     */
+    bool open(const std::string &device, uint32_t baudrate, int mode, uint8_t vmin = 1);
+
+    /**
+     * @brief Close the tty
+     *
+     */
+    void close(void);
+
+    /**
+     * @brief Whether a tty is open
+     *
+     * @return true if open
+     */
+    bool isOpen(void) const { return fd >= 0; }
+
+    /**
+     * @brief Whether the driver took ASYNC_LOW_LATENCY, false e.g. for a PTY
+     *
+     * @return true if set
+     */
+    bool lowLatency(void) const { return low_latency; }
+
+    /**
+     * @brief Get the file descriptor
+     *
+     * @return File descriptor to add to an epoll set, -1 if closed
+     */
+    int descriptor(void) const { return fd; }
+
+    /**
+     * @brief Read what is buffered, does not block
+     *
+     * @param buffer Where to put the bytes
+     * @param size   Room in buffer
+     * @return Bytes read, 0 if nothing is buffered, -1 if the port failed, e.g. was unplugged
+     */
+    ssize_t read(uint8_t *buffer, size_t size);
+
+    /**
+     * @brief Write as much as the driver takes, does not block
+     *
+     * @param data   The bytes
+     * @param length Number of bytes
+     * @return Bytes written, 0 if the driver's buffer is full, -1 if the port failed
+     */
+    ssize_t write(const uint8_t *data, size_t length);
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Percentiles over the most recent samples, safe to feed and query from different threads
+ *
+ */
+class RollingPercentile
+{
+    std::mutex mtx;
+    std::vector<int64_t> samples;
+    size_t next{0};
+    bool full{false};
+
+public:
+    /**
+     * @brief Constructor for RollingPercentile object
+     *
+     * @param window Number of most recent samples the percentiles are computed over
+     */
+    explicit RollingPercentile(size_t window = 256) : samples(window) {}
+
+    /**
+     * @brief Add a sample, overwriting the oldest one when the window is full
+     *
+     * @param value The sample to add
+     */
+    void add(int64_t value);
+
+    /**
+     * @brief Get a percentile of the samples in the window
+     *
+     * @param percentile Percentile to compute, range 0 - 100
+     * @return The sample at the percentile, 0 if there are no samples
+     */
+    int64_t percentile(double percentile);
+
+    /**
+     * @brief Forget all samples, e.g. after a reconnect
+     *
+     */
+    void clear(void);
+};
+
+/**
+ * @brief Histogram with fixed 1-2-5 buckets, lock-free so it can be fed from a real-time loop
+ *
+ */
+class Histogram
+{
+public:
+    static constexpr size_t BUCKETS{20}; // Bounds 1 to 2e6, up to 2 s for delays in us
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS + 1]{}; // The last one counts everything above the bounds
+    std::atomic<int64_t> maximum{0};
+
+public:
+    /**
+     * @brief Get the upper bound of a bucket
+     *
+     * @param bucket Bucket index, range 0 - BUCKETS
+     * @return Values below the bound and at least the previous bound are counted in the bucket, -1 for the overflow bucket
+     */
+    static int64_t bound(size_t bucket);
+
+    /**
+     * @brief Count a value, negative values count as 0
+     *
+     * @param value The value to count
+     */
+    void add(int64_t value);
+
+    /**
+     * @brief Get the number of values in a bucket
+     *
+     * @param bucket Bucket index, range 0 - BUCKETS
+     * @return Values counted in the bucket
+     */
+    uint64_t count(size_t bucket) const { return counts[bucket].load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get the number of values counted
+     *
+     * @return Sum over all buckets
+     */
+    uint64_t total(void) const;
+
+    /**
+     * @brief Get the bucket bound a percentile of the values lies below
+     *
+     * @param percentile Percentile to compute, range 0 - 100
+     * @return Upper bound of the bucket, max() if it is in the overflow bucket, 0 if empty
+     */
+    int64_t percentile(double percentile) const;
+
+    /**
+     * @brief Get the largest value counted
+     *
+     * @return Largest value, 0 if empty
+     */
+    int64_t max(void) const { return maximum.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Start over
+     *
+     */
+    void clear(void);
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Hashed timing wheel for periodic jobs
+ *
+ * Every job sits in the slot of its next expiry. A tick only visits the jobs in one slot, so the
+ * cost of a tick depends on the jobs that are due around it, not on the total number of jobs.
+ * Periods longer than the wheel wait a number of full turns in their slot.
+ */
+class TimerWheel
+{
+    struct Entry
+    {
+        int id;
+        uint64_t period; // In ticks
+        uint64_t rounds; // Full turns of the wheel left before the entry is due
+    };
+
+    std::vector<std::vector<Entry>> slots;
+    std::vector<Entry> fired;
+    uint64_t tick;       // Tick length in ns
+    uint64_t origin{0};  // Protocol::now() of tick 0
+    uint64_t current{0}; // Ticks processed so far
+
+    /**
+     * @brief Put an entry into the slot it expires in
+     *
+     * @param entry The entry, rounds is computed here
+     * @param delay Ticks from the current tick, at least 1
+     */
+    void insert(Entry entry, uint64_t delay);
+
+public:
+    /**
+     * @brief Constructor for TimerWheel object
+     *
+     * @param tick  Resolution of the wheel in ns, periods are rounded to it
+     * @param slots Number of slots, one turn of the wheel is slots * tick
+     */
+    explicit TimerWheel(uint64_t tick, size_t slots = 256) : slots(slots), tick{tick} {}
+
+    /**
+     * @brief Add a periodic job, first due at the next tick
+     *
+     * @param id     Reported to the callback of advance()
+     * @param period Period in ns, at least one tick
+     */
+    void add(int id, uint64_t period);
+
+    /**
+     * @brief Set the time of tick 0
+     *
+     * @param now Protocol::now()
+     */
+    void start(uint64_t now) { origin = now; }
+
+    /**
+     * @brief Get the time the next tick is due, an absolute deadline that does not drift
+     *
+     * @return Protocol::now() value of the next tick
+     */
+    uint64_t deadline(void) const { return origin + (current + 1) * tick; }
+
+    /**
+     * @brief Process every tick up to now and report the jobs that are due
+     *
+     * @param now Protocol::now()
+     * @param due Called as due(int id) for every job that expired, once per expiry
+     */
+    template <typename Callback>
+    void advance(uint64_t now, Callback &&due)
+    {
+        while (deadline() <= now)
+        {
+            current++;
+            std::vector<Entry> &slot = slots[current % slots.size()];
+
+            for (size_t i = 0; i < slot.size();)
+            {
+                if (slot[i].rounds == 0)
+                {
+                    due(slot[i].id);
+                    fired.push_back(slot[i]);
+                    slot[i] = slot.back();
+                    slot.pop_back();
+                }
+                else
+                {
+                    slot[i].rounds--;
+                    i++;
+                }
+            }
+
+            // Rescheduled after the slot is done, a job with a period of one turn lands in the same slot.
+            for (const Entry &entry : fired)
+            {
+                insert(entry, entry.period);
+            }
+            fired.clear();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef USBSERIAL_H
+#define USBSERIAL_H
+
+#include <string>
+
+// USB serial numbers of tty devices, read straight from sysfs.
+// A lookup costs a stat() of the device node while the device stays plugged in: the result is
+// cached per device node, and a node that was created again after a replug is looked up anew.
+
+namespace UsbSerial
+{
+    /**
+     * @brief Get the serial number of the USB device behind a tty, the ID_SERIAL_SHORT of udev
+     *
+     * @param device Device node, e.g. /dev/ttyUSB0
+     * @param sysfs  Where sysfs is mounted
+     * @return The serial number, empty if the device does not exist or is not a USB device
+     */
+    std::string serial(const std::string &device, const std::string &sysfs = "/sys");
+
+    /**
+     * @brief Find the tty of the USB device with a serial number
+     *
+     * @param serial The serial number, see serial()
+     * @param sysfs  Where sysfs is mounted
+     * @return Device node, e.g. /dev/ttyACM0, empty if the device is not plugged in
+     */
+    std::string find(const std::string &serial, const std::string &sysfs = "/sys");
+
+    /**
+     * @brief Find the port of a device by its serial number, or by its path if it has none
+     *
+     * @param configured Device node the device is expected at, e.g. SERVER_PORT
+     * @param serial     Serial number of the device, looked up at configured while empty
+     * @param sysfs      Where sysfs is mounted
+     * @return Device node, configured itself if it exists but is no USB device (e.g. a PTY of the
+     *         simulator), empty if the device is not plugged in
+     */
+    std::string locate(const std::string &configured, std::string &serial, const std::string &sysfs = "/sys");
+
+    /**
+     * @brief Forget the cached serial numbers, e.g. after a hotplug event
+     *
+     */
+    void forget(void);
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Minimal RFC 6455 server side: the upgrade handshake and binary framing.
+// Protocol messages are carried unchanged as the payload of binary frames.
+
+namespace WebSocket
+{
+    enum class Opcode : uint8_t
+    {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xA,
+    };
+
+    // Largest client frame payload: one whole protocol message, 3 header bytes and a 16 bit length.
+    constexpr uint64_t MAX_PAYLOAD{3 + 0xFFFF};
+
+    /**
+     * @brief Build the reply to an HTTP upgrade request
+     *
+     * @param request The complete request including the terminating empty line
+     * @return The 101 Switching Protocols response, empty if the request is not a WebSocket upgrade
+     */
+    std::string handshake(const std::string &request);
+
+    /**
+     * @brief Append an unmasked server-to-client frame
+     *
+     * @param opcode  Frame type
+     * @param payload Frame payload
+     * @param length  Payload length
+     * @param out     Bytes are appended to the end of this vector
+     */
+    void frame(Opcode opcode, const uint8_t *payload, size_t length, std::vector<uint8_t> &out);
+
+    /**
+     * @brief Reassembles and unmasks client-to-server frames
+     *
+     */
+    class Parser
+    {
+        std::vector<uint8_t> pending;
+        bool failed{false};
+
+    public:
+        /**
+         * @brief Consume received bytes and report every complete frame
+         *
+         * @param data     Received bytes
+         * @param length   Number of received bytes
+         * @param callback Called as callback(Opcode, const uint8_t *payload, size_t length)
+         * @return false once the client sent an unmasked frame or one longer than MAX_PAYLOAD, the connection must be closed
+         */
+        template <typename Callback>
+        bool feed(const uint8_t *data, size_t length, Callback &&callback)
+        {
+            if (failed)
+            {
+                return false;
+            }
+            pending.insert(pending.end(), data, data + length);
+
+            size_t offset{0};
+            while (pending.size() - offset >= 2)
+            {
+                uint8_t *header{pending.data() + offset};
+                size_t available{pending.size() - offset};
+
+                bool masked{(header[1] & 0x80) != 0};
+                uint64_t payload_length{header[1] & 0x7Fu};
+                size_t header_length{2};
+
+                if (payload_length == 126)
+                {
+                    header_length += 2;
+                }
+                else if (payload_length == 127)
+                {
+                    header_length += 8;
+                }
+
+                if (available < header_length + (masked ? 4 : 0))
+                {
+                    break;
+                }
+
+                if (payload_length >= 126)
+                {
+                    payload_length = 0;
+                    for (size_t i = 2; i < header_length; i++)
+                    {
+                        payload_length = (payload_length << 8) | header[i];
+                    }
+                }
+
+                // Clients must mask every frame (RFC 6455 5.1), and a longer frame would only grow pending.
+                if (!masked || payload_length > MAX_PAYLOAD)
+                {
+                    failed = true;
+                    pending.clear();
+                    pending.shrink_to_fit();
+                    return false;
+                }
+
+                const uint8_t *mask{header + header_length};
+                header_length += 4;
+
+                if (available - header_length < payload_length)
+                {
+                    break; // Wait for the rest of the frame
+                }
+
+                uint8_t *payload{header + header_length};
+                for (uint64_t i = 0; i < payload_length; i++)
+                {
+                    payload[i] ^= mask[i % 4];
+                }
+
+                callback(static_cast<Opcode>(header[0] & 0x0F), payload, static_cast<size_t>(payload_length));
+                offset += header_length + payload_length;
+            }
+
+            pending.erase(pending.begin(), pending.begin() + offset);
+            return true;
+        }
+    };
+}
+
+#endif
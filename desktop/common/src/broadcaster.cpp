@@ -0,0 +1,667 @@
+#include "broadcaster.h"
+#include <cerrno>
+#include <iterator>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Queued frames per session before the unsent ones are replaced by a keyframe.
+constexpr size_t QUEUE_LIMIT{64};
+
+// Unsent bytes the kernel holds per session, more waits in the priority queues.
+constexpr int NOTSENT_LOWAT{4096};
+
+// Frames waiting in all queues of a session.
+template <typename Lanes>
+static size_t backlog(const Lanes &lanes)
+{
+    size_t frames{0};
+    for (const auto &lane : lanes)
+    {
+        frames += lane.size();
+    }
+    return frames;
+}
+
+Broadcaster::~Broadcaster()
+{
+    for (auto &[fd, session] : sessions)
+    {
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
+    }
+
+    if (listenfd >= 0)
+    {
+        close(listenfd);
+    }
+}
+
+bool Broadcaster::attach(int epoll)
+{
+    epfd = epoll;
+
+    if (listenfd < 0)
+    {
+        listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_IP);
+
+        if (listenfd < 0)
+        {
+            return false;
+        }
+
+        int optval = 1;
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+
+        sockaddr_in servaddr{};
+        servaddr.sin_family = AF_INET;
+        servaddr.sin_port = htons(port);
+        servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        if (0 != bind(listenfd, (sockaddr *)&servaddr, sizeof(servaddr)) || 0 != listen(listenfd, SOMAXCONN))
+        {
+            close(listenfd);
+            listenfd = -1;
+            return false;
+        }
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &event);
+
+    return true;
+}
+
+bool Broadcaster::handle(int fd, uint32_t events)
+{
+    if (fd == listenfd)
+    {
+        accept_sessions();
+        return true;
+    }
+
+    auto it = sessions.find(fd);
+    if (it == sessions.end())
+    {
+        return false;
+    }
+
+    if (events & (EPOLLERR | EPOLLHUP))
+    {
+        drop(fd);
+        return true;
+    }
+
+    if (events & EPOLLIN)
+    {
+        read_session(fd, it->second);
+    }
+
+    // The session may have been dropped while reading.
+    it = sessions.find(fd);
+    if (it != sessions.end() && (events & EPOLLOUT))
+    {
+        it->second.writable = true;
+        flush(fd, it->second);
+    }
+
+    return true;
+}
+
+void Broadcaster::accept_sessions(void)
+{
+    while (true)
+    {
+        int fd = accept4(listenfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            break; // EAGAIN: no more pending connections
+        }
+
+        // Frames are small and latency matters more than packet count.
+        int optval = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+        int lowat = NOTSENT_LOWAT;
+        setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+
+        sessions[fd].upgraded = (framing == Framing::STREAM);
+    }
+}
+
+void Broadcaster::read_session(int fd, Session &session)
+{
+    uint8_t buffer[512];
+
+    // A handler that drops the session, e.g. on a failed reply, only marks it, the parsers still hold its buffers.
+    reading = fd;
+    while (!session.closed)
+    {
+        ssize_t bytes_read{read(fd, buffer, sizeof(buffer))};
+
+        if (bytes_read > 0)
+        {
+            uint64_t received{Protocol::now()};
+
+            if (session.upgraded)
+            {
+                receive(fd, session, buffer, bytes_read, received);
+            }
+            else
+            {
+                upgrade(fd, session, buffer, bytes_read, received);
+            }
+        }
+        else if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else if (bytes_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            session.closed = true; // Closed by the client or failed
+        }
+    }
+    reading = -1;
+
+    if (session.closed)
+    {
+        drop(fd);
+    }
+}
+
+void Broadcaster::receive(int fd, Session &session, const uint8_t *data, size_t length, uint64_t received)
+{
+    auto dispatch = [&](Protocol::Type type, const uint8_t *payload, size_t payload_length)
+    {
+        if (session.closed)
+        {
+            return; // Dropped by the handler of an earlier message
+        }
+
+        apply(session.control, type, payload, payload_length, received);
+
+        if (handler)
+        {
+            handler(fd, type, payload, payload_length, received);
+        }
+    };
+
+    if (framing == Framing::STREAM)
+    {
+        session.parser.feed(data, length, dispatch);
+        return;
+    }
+
+    bool valid{session.websocket.feed(data, length, [&](WebSocket::Opcode opcode, const uint8_t *payload, size_t payload_length)
+                           {
+        if (session.closed || session.closing)
+        {
+            return;
+        }
+
+        if (opcode == WebSocket::Opcode::BINARY || opcode == WebSocket::Opcode::CONTINUATION)
+        {
+            // Protocol messages may span frames, the stream parser puts them back together.
+            session.parser.feed(payload, payload_length, dispatch);
+        }
+        else if (opcode == WebSocket::Opcode::PING)
+        {
+            auto pong = std::make_shared<std::vector<uint8_t>>();
+            WebSocket::frame(WebSocket::Opcode::PONG, payload, payload_length, *pong);
+            enqueue(fd, session, pong, false, Setting::URGENT);
+        }
+        else if (opcode == WebSocket::Opcode::CLOSE)
+        {
+            // Echo the status code (RFC 6455 5.5.1) after the frame that is partly written, the
+            // frames still queued are not sent anymore. flush() drops the session once it is out.
+            for (auto &lane : session.lanes)
+            {
+                lane.clear();
+            }
+
+            auto reply = std::make_shared<std::vector<uint8_t>>();
+            WebSocket::frame(WebSocket::Opcode::CLOSE, payload, std::min<size_t>(payload_length, 2), *reply);
+            session.closing = true;
+            enqueue(fd, session, reply, false, Setting::URGENT);
+        } })};
+
+    // An unmasked or oversized frame, read_session() drops the client.
+    session.closed |= !valid;
+}
+
+void Broadcaster::apply(Control &control, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received)
+{
+    control.heard = received;
+
+    if (type == Protocol::Type::RATE)
+    {
+        Protocol::Rate rate;
+        if (Protocol::decode(payload, length, rate))
+        {
+            control.requested = rate.interval * 1000000ull;
+            control.interval = control.requested;
+            control.next_due = 0; // Start the new rate with the next frame
+        }
+    }
+    else if (type == Protocol::Type::SUBSCRIBE)
+    {
+        Protocol::Subscribe subscribe;
+        if (Protocol::decode(payload, length, subscribe))
+        {
+            control.subscription = std::move(subscribe.signals);
+        }
+    }
+    else
+    {
+        ; // KEEPALIVE only refreshes heard, everything else is for the handler
+    }
+}
+
+void Broadcaster::upgrade(int fd, Session &session, const uint8_t *data, size_t length, uint64_t received)
+{
+    session.request.append(reinterpret_cast<const char *>(data), length);
+
+    size_t end{session.request.find("\r\n\r\n")};
+    if (end == std::string::npos)
+    {
+        if (session.request.size() > 8192)
+        {
+            drop(fd); // Not a browser
+        }
+        return;
+    }
+
+    std::string response{WebSocket::handshake(session.request.substr(0, end + 4))};
+    if (response.empty())
+    {
+        drop(fd);
+        return;
+    }
+
+    std::string rest{session.request.substr(end + 4)};
+    session.request.clear();
+    session.request.shrink_to_fit();
+    session.upgraded = true;
+
+    enqueue(fd, session, std::make_shared<std::vector<uint8_t>>(response.begin(), response.end()), false, Setting::URGENT);
+
+    if (!session.closed && !rest.empty())
+    {
+        receive(fd, session, reinterpret_cast<const uint8_t *>(rest.data()), rest.size(), received);
+    }
+}
+
+Broadcaster::Frame Broadcaster::wrap(const Frame &frame) const
+{
+    if (framing == Framing::STREAM)
+    {
+        return frame;
+    }
+
+    auto wrapped = std::make_shared<std::vector<uint8_t>>();
+    wrapped->reserve(frame->size() + 10);
+    WebSocket::frame(WebSocket::Opcode::BINARY, frame->data(), frame->size(), *wrapped);
+    return wrapped;
+}
+
+Broadcaster::View Broadcaster::select(const Frame &frame, const std::vector<uint8_t> &subscription) const
+{
+    View view{nullptr, nullptr, Setting::URGENT, nullptr};
+    auto encoded = std::make_shared<std::vector<uint8_t>>();
+    std::vector<uint8_t> coverage;
+
+    // Every message of the frame is narrowed down on its own, one per channel.
+    size_t offset{0};
+    while (frame->size() - offset >= Protocol::HEADER_LEN)
+    {
+        const uint8_t *header{frame->data() + offset};
+        size_t length{static_cast<size_t>(header[1] | (header[2] << 8))};
+        auto type{static_cast<Protocol::Type>(header[0])};
+
+        if (frame->size() - offset - Protocol::HEADER_LEN < length)
+        {
+            break;
+        }
+        offset += Protocol::HEADER_LEN + length;
+
+        Protocol::Data data;
+        Protocol::Update update;
+        if (type == Protocol::Type::DATA && Protocol::decode(header + Protocol::HEADER_LEN, length, data))
+        {
+            Protocol::Update selected{Protocol::select(data, subscription)};
+            Protocol::encode(selected, *encoded);
+            Protocol::cover(coverage, selected.channel, selected.signals);
+        }
+        else if (type == Protocol::Type::UPDATE && Protocol::decode(header + Protocol::HEADER_LEN, length, update))
+        {
+            Protocol::Update selected{Protocol::select(update, subscription)};
+
+            if (std::any_of(selected.signals.begin(), selected.signals.end(), [](uint8_t bits)
+                            { return bits != 0; }))
+            {
+                Protocol::encode(selected, *encoded);
+                Protocol::cover(coverage, selected.channel, selected.signals);
+            }
+        }
+        else
+        {
+            ;
+        }
+    }
+
+    if (encoded->empty())
+    {
+        return view; // Nothing this subscription asked for
+    }
+
+    view.priority = Protocol::priority(coverage);
+    view.signals = std::make_shared<const std::vector<uint8_t>>(std::move(coverage));
+    view.frame = wrap(encoded);
+    return view;
+}
+
+void Broadcaster::flush(int fd, Session &session)
+{
+    while (session.writable)
+    {
+        if (session.writing.frame == nullptr)
+        {
+            // The most urgent queue first, a frame that is partly written is always finished.
+            auto lane = std::find_if(std::begin(session.lanes), std::end(session.lanes), [](const std::deque<Pending> &lane)
+                                     { return !lane.empty(); });
+            if (lane == std::end(session.lanes))
+            {
+                break;
+            }
+
+            session.writing = std::move(lane->front());
+            session.offset = 0;
+            lane->pop_front();
+        }
+
+        const std::vector<uint8_t> &frame = *session.writing.frame;
+
+        ssize_t bytes_written{::send(fd, frame.data() + session.offset, frame.size() - session.offset, MSG_NOSIGNAL)};
+
+        if (bytes_written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            session.writable = false;
+        }
+        else if (bytes_written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (bytes_written < 0)
+        {
+            drop(fd);
+            return;
+        }
+        else
+        {
+            session.offset += bytes_written;
+
+            if (session.offset == frame.size())
+            {
+                delays[session.writing.priority].add(static_cast<int64_t>(Protocol::now() - session.writing.queued) / 1000);
+                session.writing = Pending{};
+                session.offset = 0;
+            }
+            else
+            {
+                session.writable = false; // Socket buffer full after a partial write
+            }
+        }
+    }
+
+    // Only ask for EPOLLOUT while there is something left to write.
+    bool arm{session.writing.frame != nullptr || backlog(session.lanes) > 0};
+
+    if (!arm && session.closing)
+    {
+        drop(fd); // The Close reply is written
+        return;
+    }
+    if (arm != session.armed)
+    {
+        epoll_event event{};
+        event.events = arm ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &event);
+        session.armed = arm;
+    }
+}
+
+void Broadcaster::drop(int fd)
+{
+    auto it = sessions.find(fd);
+    if (it == sessions.end())
+    {
+        return;
+    }
+
+    // Erased by read_session() once the parsers are done with it.
+    if (fd == reading)
+    {
+        it->second.closed = true;
+        return;
+    }
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+    sessions.erase(it);
+}
+
+// Whether a frame carrying newer signals makes a pending frame with older signals redundant.
+static bool covers(const Broadcaster::Signals &newer, const Broadcaster::Signals &older)
+{
+    if (newer == nullptr)
+    {
+        return true; // A keyframe has everything
+    }
+    if (older == nullptr)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < older->size(); i++)
+    {
+        uint8_t carried{i < newer->size() ? (*newer)[i] : uint8_t{0}};
+        if ((*older)[i] & ~carried)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Broadcaster::enqueue(int fd, Session &session, const Frame &frame, bool conflate, Setting::Priority priority, const Signals &signals)
+{
+    if (conflate)
+    {
+        // Keep the frame that is partly written and all replies, replace unsent data frames the new one covers.
+        for (auto &lane : session.lanes)
+        {
+            for (auto it = lane.begin(); it != lane.end();)
+            {
+                it = (it->conflate && covers(signals, it->signals)) ? lane.erase(it) : it + 1;
+            }
+        }
+    }
+
+    session.lanes[priority].push_back({frame, conflate, signals, priority, Protocol::now()});
+
+    // A writable session is written right away, otherwise EPOLLOUT continues it.
+    if (session.writable && !session.closed)
+    {
+        flush(fd, session);
+    }
+}
+
+void Broadcaster::broadcast(const Frame &frame)
+{
+    broadcast(frame, nullptr, {});
+}
+
+void Broadcaster::broadcast(const Frame &frame, const Signals &signals, const Keyframe &keyframe)
+{
+    // Framed once for all sessions, no matter how many are connected.
+    Frame wrapped{wrap(frame)};
+    Frame wrapped_keyframe{signals == nullptr ? wrapped : nullptr};
+    Frame full{signals == nullptr ? frame : nullptr};
+    Setting::Priority priority{signals == nullptr ? Setting::URGENT : Protocol::priority(*signals)};
+
+    // One view per distinct subscription, shared by every session that asked for the same signals.
+    std::map<std::vector<uint8_t>, View> views;
+
+    uint64_t now{Protocol::now()};
+
+    // enqueue() may drop a failing session, so iterate over a copy of the keys.
+    std::vector<std::pair<int, View *>> targets;
+    targets.reserve(sessions.size());
+    for (auto &[fd, session] : sessions)
+    {
+        Control &control = session.control;
+        View *view{nullptr};
+
+        if (!session.upgraded || session.closing)
+        {
+            continue;
+        }
+        else if (!control.subscription.empty())
+        {
+            auto [it, added] = views.try_emplace(control.subscription);
+            if (added)
+            {
+                it->second = select(frame, control.subscription);
+
+                if (signals == nullptr)
+                {
+                    it->second.signals = nullptr; // Still the keyframe of the subscription
+                    it->second.priority = Setting::URGENT;
+                }
+            }
+
+            view = &it->second;
+            if (view->frame == nullptr)
+            {
+                continue; // Nothing for this client, it neither misses the frame nor uses up its rate
+            }
+        }
+        else
+        {
+            ; // Gets the frame as it is
+        }
+
+        if (now < control.next_due)
+        {
+            session.stale = true; // Skips this frame
+            continue;
+        }
+
+        // Step by the interval so the average rate is kept even though frames come in fixed ticks,
+        // but do not catch up with a burst after a pause.
+        control.next_due += control.interval;
+        if (control.next_due < now)
+        {
+            control.next_due = now + control.interval;
+        }
+        targets.emplace_back(fd, view);
+    }
+
+    for (auto [fd, view] : targets)
+    {
+        auto it = sessions.find(fd);
+        if (it == sessions.end())
+        {
+            continue;
+        }
+
+        Session &session = it->second;
+
+        // Unsent updates that no newer frame covers pile up for a client that does not read, a keyframe replaces them all.
+        if (session.stale || backlog(session.lanes) >= QUEUE_LIMIT)
+        {
+            if (full == nullptr)
+            {
+                full = keyframe();
+            }
+
+            Frame *key{&wrapped_keyframe};
+            if (view != nullptr)
+            {
+                key = &view->keyframe;
+                if (*key == nullptr)
+                {
+                    *key = (signals == nullptr) ? view->frame : select(full, session.control.subscription).frame;
+                }
+            }
+            else if (*key == nullptr)
+            {
+                *key = wrap(full);
+            }
+            else
+            {
+                ;
+            }
+
+            session.stale = false;
+            enqueue(fd, session, *key, true, Setting::URGENT);
+        }
+        else if (view != nullptr)
+        {
+            enqueue(fd, session, view->frame, true, view->priority, view->signals);
+        }
+        else
+        {
+            enqueue(fd, session, wrapped, true, priority, signals);
+        }
+    }
+}
+
+void Broadcaster::send(int session, const Frame &frame)
+{
+    auto it = sessions.find(session);
+    if (it != sessions.end() && it->second.upgraded && !it->second.closed && !it->second.closing)
+    {
+        enqueue(session, it->second, wrap(frame), false, Setting::URGENT);
+    }
+}
+
+Broadcaster::Control *Broadcaster::control(int session)
+{
+    auto it = sessions.find(session);
+    return (it == sessions.end()) ? nullptr : &it->second.control;
+}
+
+void Broadcaster::expire(uint64_t now, uint64_t timeout)
+{
+    std::vector<int> silent;
+    for (auto &[fd, session] : sessions)
+    {
+        if (session.control.heard != 0 && now - session.control.heard > timeout)
+        {
+            silent.push_back(fd);
+        }
+    }
+
+    for (int fd : silent)
+    {
+        drop(fd);
+    }
+}
@@ -0,0 +1,95 @@
+#include "clocksync.h"
+
+void ClockSync::add(const Protocol::Pong &pong, uint64_t received)
+{
+    // t1 = origin, t2 = receive, t3 = transmit, t4 = received
+    int64_t t1 = pong.origin, t2 = pong.receive, t3 = pong.transmit, t4 = received;
+
+    Sample sample{};
+    sample.local = pong.origin + (received - pong.origin) / 2;
+    sample.offset = ((t2 - t1) + (t3 - t4)) / 2;
+    sample.delay = (t4 - t1) - (t3 - t2);
+
+    samples[next] = sample;
+    next = (next + 1) % WINDOW;
+
+    if (count < WINDOW)
+    {
+        count++;
+    }
+
+    estimate();
+}
+
+void ClockSync::estimate(void)
+{
+    // Offset: the sample with the shortest round trip among the most recent ones
+    size_t recent{count < FILTER ? count : FILTER};
+    best = samples[(next + WINDOW - 1) % WINDOW];
+
+    for (size_t i = 1; i < recent; i++)
+    {
+        const Sample &sample = samples[(next + WINDOW - 1 - i) % WINDOW];
+
+        if (sample.delay < best.delay)
+        {
+            best = sample;
+        }
+    }
+
+    // Drift: least squares line through the samples that were not delayed by queueing
+    int64_t min_delay{best.delay};
+    for (size_t i = 0; i < count; i++)
+    {
+        if (samples[i].delay < min_delay)
+        {
+            min_delay = samples[i].delay;
+        }
+    }
+
+    double n{0}, sum_x{0}, sum_y{0}, sum_xx{0}, sum_xy{0};
+    for (size_t i = 0; i < count; i++)
+    {
+        const Sample &sample = samples[i];
+
+        if (sample.delay <= 2 * min_delay + 100000) // Within 100 us of twice the best round trip
+        {
+            // Center on the best sample to keep the doubles precise
+            double x = static_cast<double>(static_cast<int64_t>(sample.local - best.local));
+            double y = static_cast<double>(sample.offset - best.offset);
+            n += 1;
+            sum_x += x;
+            sum_y += y;
+            sum_xx += x * x;
+            sum_xy += x * y;
+        }
+    }
+
+    double denominator{n * sum_xx - sum_x * sum_x};
+    drift = (n >= 4 && denominator > 0) ? (n * sum_xy - sum_x * sum_y) / denominator : 0.0;
+}
+
+uint64_t ClockSync::toLocal(uint64_t server) const
+{
+    // server = local + offset(local), solved for local with the offset evaluated at the server time
+    double elapsed = static_cast<double>(static_cast<int64_t>(server - best.offset - best.local));
+    int64_t offset = best.offset + static_cast<int64_t>(drift * elapsed);
+
+    return server - offset;
+}
+
+uint64_t ClockSync::toServer(uint64_t local) const
+{
+    double elapsed = static_cast<double>(static_cast<int64_t>(local - best.local));
+    int64_t offset = best.offset + static_cast<int64_t>(drift * elapsed);
+
+    return local + offset;
+}
+
+void ClockSync::reset(void)
+{
+    count = 0;
+    next = 0;
+    best = Sample{};
+    drift = 0.0;
+}
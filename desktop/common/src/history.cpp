@@ -0,0 +1,150 @@
+#include "history.h"
+#include <cstring>
+#include <algorithm>
+
+// Samples per BACKFILL message, keeps the worst case well below the 16-bit payload length.
+constexpr size_t MESSAGE_SAMPLES{std::max<size_t>(1, 16384 / BUFLEN)};
+
+// Run-length tokens: 0x00 - 0x7F are followed by token + 1 literal bytes, 0x80 - 0xFF stand for token - 0x7F zero bytes.
+constexpr size_t RUN{128};
+
+static void compress(const std::vector<uint8_t> &raw, std::vector<uint8_t> &out)
+{
+    size_t i{0};
+    while (i < raw.size())
+    {
+        size_t zeros{0};
+        while (i + zeros < raw.size() && raw[i + zeros] == 0 && zeros < RUN)
+        {
+            zeros++;
+        }
+
+        if (zeros > 0)
+        {
+            out.push_back(static_cast<uint8_t>(0x7F + zeros));
+            i += zeros;
+            continue;
+        }
+
+        size_t literals{0};
+        while (i + literals < raw.size() && raw[i + literals] != 0 && literals < RUN)
+        {
+            literals++;
+        }
+
+        out.push_back(static_cast<uint8_t>(literals - 1));
+        out.insert(out.end(), raw.begin() + i, raw.begin() + i + literals);
+        i += literals;
+    }
+}
+
+static bool decompress(const std::vector<uint8_t> &in, size_t length, std::vector<uint8_t> &raw)
+{
+    size_t i{0};
+    while (i < in.size())
+    {
+        uint8_t token{in[i++]};
+
+        if (token >= 0x80)
+        {
+            raw.insert(raw.end(), token - 0x7F, 0);
+        }
+        else if (i + token + 1u <= in.size())
+        {
+            raw.insert(raw.end(), in.begin() + i, in.begin() + i + token + 1);
+            i += token + 1u;
+        }
+        else
+        {
+            return false; // Truncated literal run
+        }
+    }
+    return raw.size() == length;
+}
+
+History::History(size_t channels, size_t capacity, uint64_t interval)
+    : channels{channels}, capacity{std::max<size_t>(capacity, 1)}, interval{interval},
+      timestamps(this->capacity), payloads(this->capacity * channels * BUFLEN)
+{
+}
+
+uint8_t *History::push(uint64_t timestamp)
+{
+    size_t slot{next};
+
+    timestamps[slot] = timestamp;
+    next = (next + 1) % capacity;
+    count = std::min(count + 1, capacity);
+
+    return payloads.data() + slot * channels * BUFLEN;
+}
+
+void History::backfill(uint16_t channel, uint64_t since, std::vector<uint8_t> &out) const
+{
+    if (channel >= channels)
+    {
+        return;
+    }
+
+    // Oldest slot first, skipping the samples before since.
+    size_t first{(next + capacity - count) % capacity};
+    size_t skip{0};
+    while (skip < count && timestamps[(first + skip) % capacity] < since)
+    {
+        skip++;
+    }
+
+    for (size_t done = skip; done < count;)
+    {
+        size_t samples{std::min(MESSAGE_SAMPLES, count - done)};
+        std::vector<uint8_t> raw(samples * BUFLEN);
+        const uint8_t *previous{nullptr};
+
+        for (size_t i = 0; i < samples; i++)
+        {
+            const uint8_t *payload{payloads.data() + ((first + done + i) % capacity * channels + channel) * BUFLEN};
+
+            // Only the bits that changed since the previous sample are left, every message starts from zero.
+            for (size_t byte = 0; byte < BUFLEN; byte++)
+            {
+                raw[i * BUFLEN + byte] = payload[byte] ^ (previous ? previous[byte] : 0);
+            }
+            previous = payload;
+        }
+
+        Protocol::Backfill message{};
+        message.channel = channel;
+        message.timestamp = timestamps[(first + done) % capacity];
+        message.interval = static_cast<uint32_t>(interval / 1000);
+        message.count = static_cast<uint16_t>(samples);
+        compress(raw, message.samples);
+        Protocol::encode(message, out);
+
+        done += samples;
+    }
+}
+
+bool History::expand(const Protocol::Backfill &backfill, std::vector<Sample> &samples)
+{
+    std::vector<uint8_t> raw;
+    raw.reserve(backfill.count * BUFLEN);
+
+    if (!decompress(backfill.samples, backfill.count * BUFLEN, raw))
+    {
+        return false;
+    }
+
+    uint8_t payload[BUFLEN]{};
+    for (size_t i = 0; i < backfill.count; i++)
+    {
+        for (size_t byte = 0; byte < BUFLEN; byte++)
+        {
+            payload[byte] ^= raw[i * BUFLEN + byte];
+        }
+
+        Sample sample{backfill.timestamp + i * backfill.interval * 1000ull, {}};
+        memcpy(sample.payload, payload, BUFLEN);
+        samples.push_back(sample);
+    }
+    return true;
+}
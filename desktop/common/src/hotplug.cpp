@@ -0,0 +1,173 @@
+#include "hotplug.h"
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+// Multicast group of the kernel's own uevents, udev re-broadcasts them on group 2 in its own format.
+constexpr unsigned int KERNEL_GROUP{1};
+
+Hotplug::Hotplug(const std::string &subsystem) : subsystem{subsystem}
+{
+    netlink = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+
+    if (netlink >= 0)
+    {
+        sockaddr_nl address{};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = KERNEL_GROUP;
+
+        if (0 != bind(netlink, reinterpret_cast<sockaddr *>(&address), sizeof(address)))
+        {
+            close(netlink);
+            netlink = -1;
+        }
+    }
+
+    if (0 != socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, injected))
+    {
+        injected[0] = injected[1] = -1;
+    }
+
+    poller = epoll_create1(EPOLL_CLOEXEC);
+
+    for (int fd : {netlink, injected[0]})
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+
+        if (fd >= 0 && poller >= 0)
+        {
+            epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+}
+
+Hotplug::~Hotplug()
+{
+    for (int fd : {poller, netlink, injected[0], injected[1]})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+}
+
+bool Hotplug::parse(const char *message, size_t length, Event &event)
+{
+    const char *end{message + length};
+
+    // The header is ACTION@DEVPATH, udev's own messages start with "libudev" instead.
+    if (length == 0 || memchr(message, '@', strnlen(message, length)) == nullptr)
+    {
+        return false;
+    }
+
+    std::string action;
+    event = Event{Action::OTHER, {}, {}};
+
+    for (const char *entry = message + strnlen(message, length) + 1; entry < end; entry += strnlen(entry, end - entry) + 1)
+    {
+        std::string pair{entry, strnlen(entry, end - entry)};
+        size_t equals{pair.find('=')};
+
+        if (equals == std::string::npos)
+        {
+            continue;
+        }
+
+        std::string key{pair.substr(0, equals)};
+        std::string value{pair.substr(equals + 1)};
+
+        if (key == "ACTION")
+        {
+            action = value;
+        }
+        else if (key == "SUBSYSTEM")
+        {
+            event.subsystem = value;
+        }
+        else if (key == "DEVNAME")
+        {
+            event.device = (value.rfind("/dev/", 0) == 0) ? value : "/dev/" + value;
+        }
+        else
+        {
+            ;
+        }
+    }
+
+    if (action == "add")
+    {
+        event.action = Action::ADD;
+    }
+    else if (action == "remove")
+    {
+        event.action = Action::REMOVE;
+    }
+    else
+    {
+        ;
+    }
+
+    return !action.empty();
+}
+
+bool Hotplug::receive(int fd, Event &event)
+{
+    char message[8192];
+    ssize_t length{recv(fd, message, sizeof(message), 0)};
+
+    return length > 0 && parse(message, length, event) && event.subsystem == subsystem;
+}
+
+bool Hotplug::wait(int timeout, Event &event)
+{
+    auto deadline{std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout)};
+
+    while (true)
+    {
+        pollfd fds[2]{{netlink, POLLIN, 0}, {injected[0], POLLIN, 0}};
+        int remaining{static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count())};
+
+        int ready{poll(fds, 2, std::max(remaining, 0))};
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (ready <= 0 || woken.exchange(false))
+        {
+            return false;
+        }
+
+        // Events of other subsystems are skipped and the wait goes on.
+        for (const pollfd &fd : fds)
+        {
+            if ((fd.revents & POLLIN) && receive(fd.fd, event))
+            {
+                return true;
+            }
+        }
+    }
+}
+
+void Hotplug::wake(void)
+{
+    woken = true;
+    inject(std::string(1, '\0'));
+}
+
+void Hotplug::inject(const std::string &uevent)
+{
+    if (injected[1] >= 0 && send(injected[1], uevent.data(), uevent.size(), 0) < 0)
+    {
+        ; // Dropped when the queue is full, like a netlink overrun
+    }
+}
@@ -0,0 +1,383 @@
+#include "protocol.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+static void put_u16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void put_u64(std::vector<uint8_t> &out, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        out.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static uint16_t get_u16(const uint8_t *in)
+{
+    return in[0] | (in[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *in)
+{
+    return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+static uint64_t get_u64(const uint8_t *in)
+{
+    return get_u32(in) | (static_cast<uint64_t>(get_u32(in + 4)) << 32);
+}
+
+static void put_header(std::vector<uint8_t> &out, Protocol::Type type, uint16_t length)
+{
+    out.push_back(static_cast<uint8_t>(type));
+    put_u16(out, length);
+}
+
+static bool get_bit(const uint8_t *in, size_t bit)
+{
+    return (in[bit / 8] >> (bit % 8)) & 1;
+}
+
+static void set_bit(uint8_t *out, size_t bit, bool value)
+{
+    out[bit / 8] = (out[bit / 8] & ~(1 << (bit % 8))) | (value << (bit % 8));
+}
+
+struct Layout
+{
+    int start;
+    int length;
+    Setting::Priority priority;
+};
+
+// SIGNAL_LIST in index order, looked up by name once instead of for every message.
+static const std::vector<Layout> &layout(void)
+{
+    static const std::vector<Layout> signals = []()
+    {
+        Setting::Signal &signal{Setting::Signal::handle()};
+        std::vector<Layout> list;
+
+        for (size_t index = 0; index < signal.size(); index++)
+        {
+            const auto &value = signal[signal.name(index)];
+            list.push_back(Layout{value.start, value.length, value.priority});
+        }
+        return list;
+    }();
+
+    return signals;
+}
+
+uint64_t Protocol::now(void)
+{
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+void Protocol::encode(const Data &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::DATA, 4 + 8 + 1 + 2 + BUFLEN);
+    put_u32(out, message.sequence);
+    put_u64(out, message.timestamp);
+    out.push_back(message.hops);
+    put_u16(out, message.channel);
+    out.insert(out.end(), message.payload, message.payload + BUFLEN);
+}
+
+void Protocol::pack(const uint8_t *buffer, Update &update)
+{
+    const std::vector<Layout> &signals{layout()};
+    size_t bit{0};
+
+    update.values.clear();
+    for (size_t index = 0; index < signals.size(); index++)
+    {
+        if (index / 8 >= update.signals.size() || !get_bit(update.signals.data(), index))
+        {
+            continue;
+        }
+
+        const Layout &value = signals[index];
+        update.values.resize((bit + value.length + 7) / 8);
+
+        for (int i = 0; i < value.length; i++, bit++)
+        {
+            set_bit(update.values.data(), bit, get_bit(buffer, value.start + i));
+        }
+    }
+}
+
+void Protocol::apply(const Update &update, uint8_t *buffer)
+{
+    const std::vector<Layout> &signals{layout()};
+    size_t bit{0};
+
+    for (size_t index = 0; index < signals.size(); index++)
+    {
+        if (index / 8 >= update.signals.size() || !get_bit(update.signals.data(), index))
+        {
+            continue;
+        }
+
+        const Layout &value = signals[index];
+        if (bit + value.length > update.values.size() * 8)
+        {
+            break; // Truncated, the rest is not there
+        }
+
+        for (int i = 0; i < value.length; i++, bit++)
+        {
+            set_bit(buffer, value.start + i, get_bit(update.values.data(), bit));
+        }
+    }
+}
+
+Protocol::Update Protocol::select(const Update &update, const std::vector<uint8_t> &subscription)
+{
+    uint8_t buffer[BUFLEN]{};
+    apply(update, buffer);
+
+    Update selected{update.sequence, update.timestamp, update.hops, update.channel, update.signals, {}};
+    for (size_t i = 0; i < selected.signals.size(); i++)
+    {
+        selected.signals[i] &= (i < subscription.size()) ? subscription[i] : 0;
+    }
+
+    pack(buffer, selected);
+    return selected;
+}
+
+Protocol::Update Protocol::select(const Data &data, const std::vector<uint8_t> &subscription)
+{
+    Update selected{data.sequence, data.timestamp, data.hops, data.channel, subscription, {}};
+    pack(data.payload, selected);
+    return selected;
+}
+
+void Protocol::cover(std::vector<uint8_t> &coverage, uint16_t channel, const std::vector<uint8_t> &signals)
+{
+    size_t count{layout().size()};
+    size_t first{channel * count};
+
+    coverage.resize(std::max(coverage.size(), (first + count + 7) / 8));
+    for (size_t index = 0; index < count && index / 8 < signals.size(); index++)
+    {
+        if (get_bit(signals.data(), index))
+        {
+            set_bit(coverage.data(), first + index, true);
+        }
+    }
+}
+
+Setting::Priority Protocol::priority(const std::vector<uint8_t> &signals)
+{
+    const std::vector<Layout> &list{layout()};
+    Setting::Priority most{signals.empty() ? Setting::URGENT : Setting::BULK};
+
+    // The bitmap may cover many channels, bit i is signal i % signals of a channel.
+    for (size_t bit = 0; bit < signals.size() * 8 && most != Setting::URGENT && !list.empty(); bit++)
+    {
+        if (get_bit(signals.data(), bit))
+        {
+            most = std::min(most, list[bit % list.size()].priority);
+        }
+    }
+    return most;
+}
+
+void Protocol::encode(const Update &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::UPDATE, 4 + 8 + 1 + 2 + 1 + message.signals.size() + message.values.size());
+    put_u32(out, message.sequence);
+    put_u64(out, message.timestamp);
+    out.push_back(message.hops);
+    put_u16(out, message.channel);
+    out.push_back(message.signals.size());
+    out.insert(out.end(), message.signals.begin(), message.signals.end());
+    out.insert(out.end(), message.values.begin(), message.values.end());
+}
+
+void Protocol::encode(const Ping &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::PING, 8);
+    put_u64(out, message.origin);
+}
+
+void Protocol::encode(const Pong &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::PONG, 3 * 8);
+    put_u64(out, message.origin);
+    put_u64(out, message.receive);
+    put_u64(out, message.transmit);
+}
+
+void Protocol::encode(const Subscribe &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::SUBSCRIBE, message.signals.size());
+    out.insert(out.end(), message.signals.begin(), message.signals.end());
+}
+
+void Protocol::encode(const Rate &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::RATE, 2);
+    put_u16(out, message.interval);
+}
+
+void Protocol::encode(const Ack &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::ACK, 4 + 8 + 8);
+    put_u32(out, message.sequence);
+    put_u64(out, message.sent);
+    put_u64(out, message.rendered);
+}
+
+void Protocol::encode(const Keepalive &, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::KEEPALIVE, 0);
+}
+
+void Protocol::encode(const History &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::HISTORY, 2 + 2);
+    put_u16(out, message.channel);
+    put_u16(out, message.seconds);
+}
+
+void Protocol::encode(const Backfill &message, std::vector<uint8_t> &out)
+{
+    put_header(out, Type::BACKFILL, 2 + 8 + 4 + 2 + message.samples.size());
+    put_u16(out, message.channel);
+    put_u64(out, message.timestamp);
+    put_u32(out, message.interval);
+    put_u16(out, message.count);
+    out.insert(out.end(), message.samples.begin(), message.samples.end());
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, Data &message)
+{
+    if (length < 4 + 8 + 1 + 2 + BUFLEN)
+    {
+        return false;
+    }
+
+    message.sequence = get_u32(payload);
+    message.timestamp = get_u64(payload + 4);
+    message.hops = payload[12];
+    message.channel = get_u16(payload + 13);
+    memcpy(message.payload, payload + 4 + 8 + 1 + 2, BUFLEN);
+    return true;
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, Update &message)
+{
+    if (length < 4 + 8 + 1 + 2 + 1 || length < 4 + 8 + 1 + 2 + 1 + static_cast<size_t>(payload[15]))
+    {
+        return false;
+    }
+
+    const uint8_t *signals{payload + 4 + 8 + 1 + 2 + 1};
+    const uint8_t *values{signals + payload[15]};
+
+    message.sequence = get_u32(payload);
+    message.timestamp = get_u64(payload + 4);
+    message.hops = payload[12];
+    message.channel = get_u16(payload + 13);
+    message.signals.assign(signals, values);
+    message.values.assign(values, payload + length);
+    return true;
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, Ping &message)
+{
+    if (length < 8)
+    {
+        return false;
+    }
+
+    message.origin = get_u64(payload);
+    return true;
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, Pong &message)
+{
+    if (length < 3 * 8)
+    {
+        return false;
+    }
+
+    message.origin = get_u64(payload);
+    message.receive = get_u64(payload + 8);
+    message.transmit = get_u64(payload + 16);
+    return true;
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, Subscribe &message)
+{
+    message.signals.assign(payload, payload + length);
+    return true;
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, Rate &message)
+{
+    if (length < 2)
+    {
+        return false;
+    }
+
+    message.interval = get_u16(payload);
+    return true;
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, Ack &message)
+{
+    if (length < 4 + 8 + 8)
+    {
+        return false;
+    }
+
+    message.sequence = get_u32(payload);
+    message.sent = get_u64(payload + 4);
+    message.rendered = get_u64(payload + 12);
+    return true;
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, History &message)
+{
+    if (length < 2 + 2)
+    {
+        return false;
+    }
+
+    message.channel = get_u16(payload);
+    message.seconds = get_u16(payload + 2);
+    return true;
+}
+
+bool Protocol::decode(const uint8_t *payload, size_t length, Backfill &message)
+{
+    if (length < 2 + 8 + 4 + 2)
+    {
+        return false;
+    }
+
+    message.channel = get_u16(payload);
+    message.timestamp = get_u64(payload + 2);
+    message.interval = get_u32(payload + 10);
+    message.count = get_u16(payload + 14);
+    message.samples.assign(payload + 16, payload + length);
+    return true;
+}
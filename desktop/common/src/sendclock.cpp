@@ -0,0 +1,95 @@
+#include "sendclock.h"
+#include "protocol.h"
+#include <cerrno>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+
+// Protocol::now() is std::chrono::steady_clock, which is CLOCK_MONOTONIC on Linux.
+
+SendClock::SendClock()
+{
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+}
+
+SendClock::~SendClock()
+{
+    if (timerfd >= 0)
+    {
+        close(timerfd);
+    }
+}
+
+void SendClock::arm(uint64_t deadline)
+{
+    due = deadline;
+
+    itimerspec spec{};
+    spec.it_value.tv_sec = deadline / 1000000000;
+    spec.it_value.tv_nsec = deadline % 1000000000;
+
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+    {
+        spec.it_value.tv_nsec = 1; // All zero would disarm the timer
+    }
+
+    timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void SendClock::advance(uint64_t period)
+{
+    uint64_t next{due + period};
+    uint64_t now{Protocol::now()};
+
+    // After a stall the next deadline stays on the original grid instead of bursting to catch up.
+    if (next < now)
+    {
+        next += ((now - next) / period + 1) * period;
+    }
+
+    arm(next);
+}
+
+bool SendClock::expired(void)
+{
+    uint64_t expirations{0};
+
+    if ((sizeof(expirations) == read(timerfd, &expirations, sizeof(expirations))) || Protocol::now() >= due)
+    {
+        intended = due;
+        return true;
+    }
+    return false;
+}
+
+void SendClock::wait(void)
+{
+    pollfd pfd{timerfd, POLLIN, 0};
+
+    while (!expired())
+    {
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+        {
+            break;
+        }
+    }
+}
+
+void SendClock::sent(void)
+{
+    jitter.add(static_cast<int64_t>(Protocol::now() - intended) / 1000);
+}
+
+bool SendClock::realtime(int priority)
+{
+    if (priority <= 0)
+    {
+        return false;
+    }
+
+    sched_param param{};
+    param.sched_priority = priority;
+    return 0 == pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
@@ -0,0 +1,120 @@
+#include "serialport.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <asm/ioctls.h>
+#include <asm/termbits.h> // termios2, <termios.h> cannot be included next to it
+
+SerialPort::~SerialPort()
+{
+    close();
+}
+
+bool SerialPort::open(const std::string &device, uint32_t baudrate, int mode, uint8_t vmin)
+{
+    close();
+
+    fd = ::open(device.c_str(), mode | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct termios2 tio{};
+    if (0 != ioctl(fd, TCGETS2, &tio))
+    {
+        close();
+        return false;
+    }
+
+    tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+    tio.c_oflag &= ~OPOST;
+    tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD);
+    tio.c_cflag |= CS8 | CREAD | CLOCAL | BOTHER;
+    tio.c_ispeed = baudrate;
+    tio.c_ospeed = baudrate;
+
+    // VTIME 0: with a VTIME the tty polls readable at the first byte, VMIN would not matter.
+    tio.c_cc[VMIN] = vmin;
+    tio.c_cc[VTIME] = 0;
+
+    if (0 != ioctl(fd, TCSETS2, &tio))
+    {
+        close();
+        return false;
+    }
+
+    struct serial_struct serial{};
+    if (0 == ioctl(fd, TIOCGSERIAL, &serial))
+    {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        low_latency = (0 == ioctl(fd, TIOCSSERIAL, &serial));
+    }
+
+    // Whatever was buffered before the open belongs to no one.
+    ioctl(fd, TCFLSH, TCIOFLUSH);
+    return true;
+}
+
+void SerialPort::close(void)
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    fd = -1;
+    low_latency = false;
+}
+
+ssize_t SerialPort::read(uint8_t *buffer, size_t size)
+{
+    while (true)
+    {
+        ssize_t length{::read(fd, buffer, size)};
+
+        if (length > 0)
+        {
+            return length;
+        }
+        else if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        else
+        {
+            return -1; // EIO once the device is gone, or 0 bytes at hangup
+        }
+    }
+}
+
+ssize_t SerialPort::write(const uint8_t *data, size_t length)
+{
+    while (true)
+    {
+        ssize_t written{::write(fd, data, length)};
+
+        if (written >= 0)
+        {
+            return written;
+        }
+        else if (errno == EINTR)
+        {
+            continue;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return 0;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#include "statistics.h"
+#include <algorithm>
+
+void RollingPercentile::add(int64_t value)
+{
+    std::scoped_lock lock{mtx};
+
+    samples[next] = value;
+    next = (next + 1) % samples.size();
+
+    if (next == 0)
+    {
+        full = true;
+    }
+}
+
+int64_t RollingPercentile::percentile(double percentile)
+{
+    std::vector<int64_t> window;
+    {
+        std::scoped_lock lock{mtx};
+        window.assign(samples.begin(), full ? samples.end() : samples.begin() + next);
+    }
+
+    if (window.empty())
+    {
+        return 0;
+    }
+
+    percentile = std::clamp(percentile, 0.0, 100.0);
+    size_t rank{static_cast<size_t>(percentile / 100.0 * (window.size() - 1) + 0.5)};
+
+    std::nth_element(window.begin(), window.begin() + rank, window.end());
+    return window[rank];
+}
+
+void RollingPercentile::clear(void)
+{
+    std::scoped_lock lock{mtx};
+    next = 0;
+    full = false;
+}
+
+int64_t Histogram::bound(size_t bucket)
+{
+    static const int64_t steps[]{1, 2, 5};
+
+    if (bucket >= BUCKETS)
+    {
+        return -1;
+    }
+
+    int64_t decade{1};
+    for (size_t i = 0; i < bucket / 3; i++)
+    {
+        decade *= 10;
+    }
+    return steps[bucket % 3] * decade;
+}
+
+void Histogram::add(int64_t value)
+{
+    value = std::max<int64_t>(value, 0);
+
+    size_t bucket{0};
+    while (bucket < BUCKETS && value >= bound(bucket))
+    {
+        bucket++;
+    }
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    int64_t largest{maximum.load(std::memory_order_relaxed)};
+    while (value > largest && !maximum.compare_exchange_weak(largest, value, std::memory_order_relaxed))
+    {
+        ;
+    }
+}
+
+uint64_t Histogram::total(void) const
+{
+    uint64_t sum{0};
+    for (size_t bucket = 0; bucket <= BUCKETS; bucket++)
+    {
+        sum += count(bucket);
+    }
+    return sum;
+}
+
+int64_t Histogram::percentile(double percentile) const
+{
+    uint64_t sum{total()};
+    if (sum == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank{static_cast<uint64_t>(std::clamp(percentile, 0.0, 100.0) / 100.0 * (sum - 1))};
+    uint64_t seen{0};
+
+    for (size_t bucket = 0; bucket < BUCKETS; bucket++)
+    {
+        seen += count(bucket);
+        if (seen > rank)
+        {
+            return std::min(bound(bucket), max());
+        }
+    }
+    return max();
+}
+
+void Histogram::clear(void)
+{
+    for (auto &count : counts)
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+    maximum.store(0, std::memory_order_relaxed);
+}
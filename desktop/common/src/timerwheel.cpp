@@ -0,0 +1,15 @@
+#include "timerwheel.h"
+
+void TimerWheel::insert(Entry entry, uint64_t delay)
+{
+    // The slot is first visited after ((delay - 1) % size) + 1 ticks, then once every turn.
+    entry.rounds = (delay - 1) / slots.size();
+    slots[(current + delay) % slots.size()].push_back(entry);
+}
+
+void TimerWheel::add(int id, uint64_t period)
+{
+    uint64_t ticks{(period + tick / 2) / tick};
+
+    insert(Entry{id, ticks > 0 ? ticks : 1, 0}, 1);
+}
@@ -0,0 +1,154 @@
+#include "usbserial.h"
+#include <map>
+#include <mutex>
+#include <cstdlib>
+#include <fstream>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// The device node identifies the plugged-in device: devtmpfs creates a new node (inode, change time) on every plug.
+struct Node
+{
+    dev_t rdev;
+    ino_t inode;
+    time_t changed;
+    long changed_ns;
+
+    bool operator==(const Node &other) const
+    {
+        return rdev == other.rdev && inode == other.inode && changed == other.changed && changed_ns == other.changed_ns;
+    }
+};
+
+struct Entry
+{
+    Node node;
+    std::string serial;
+};
+
+static std::mutex mtx;
+static std::map<std::string, Entry> cache; // Device node path -> serial number
+
+static bool identify(const std::string &device, Node &node)
+{
+    struct stat info{};
+    if (0 != stat(device.c_str(), &info))
+    {
+        return false;
+    }
+
+    node = Node{info.st_rdev, info.st_ino, info.st_ctim.tv_sec, info.st_ctim.tv_nsec};
+    return true;
+}
+
+// Walk up from the tty's device to the USB device, which is the first directory with a serial attribute.
+static std::string lookup(const std::string &name, const std::string &sysfs)
+{
+    std::string link{sysfs + "/class/tty/" + name + "/device"};
+    char *resolved{realpath(link.c_str(), nullptr)};
+
+    if (resolved == nullptr)
+    {
+        return {}; // Not a device, e.g. a virtual console
+    }
+
+    std::string path{resolved};
+    free(resolved);
+
+    // The interface (ttyACM) or the usb-serial port (ttyUSB) is at most a few levels below the USB device.
+    for (int level = 0; level < 4 && path.size() > sysfs.size(); level++)
+    {
+        std::ifstream file{path + "/serial"};
+        std::string serial;
+
+        if (file && std::getline(file, serial))
+        {
+            return serial;
+        }
+
+        path.erase(path.rfind('/'));
+    }
+
+    return {};
+}
+
+std::string UsbSerial::serial(const std::string &device, const std::string &sysfs)
+{
+    Node node{};
+    if (!identify(device, node))
+    {
+        return {};
+    }
+
+    {
+        std::scoped_lock lock(mtx);
+        auto it = cache.find(device);
+        if (it != cache.end() && it->second.node == node)
+        {
+            return it->second.serial;
+        }
+    }
+
+    std::string serial{lookup(device.substr(device.rfind('/') + 1), sysfs)};
+
+    std::scoped_lock lock(mtx);
+    cache[device] = Entry{node, serial};
+    return serial;
+}
+
+std::string UsbSerial::find(const std::string &serial, const std::string &sysfs)
+{
+    if (serial.empty())
+    {
+        return {};
+    }
+
+    DIR *dir{opendir((sysfs + "/class/tty").c_str())};
+    if (dir == nullptr)
+    {
+        return {};
+    }
+
+    std::string found;
+    while (dirent *entry = readdir(dir))
+    {
+        std::string name{entry->d_name};
+
+        // USB serial adapters and CDC-ACM devices, the ESP32 shows up as one of them.
+        if (name.rfind("ttyUSB", 0) != 0 && name.rfind("ttyACM", 0) != 0)
+        {
+            continue;
+        }
+
+        if (UsbSerial::serial("/dev/" + name, sysfs) == serial)
+        {
+            found = "/dev/" + name;
+            break;
+        }
+    }
+
+    closedir(dir);
+    return found;
+}
+
+std::string UsbSerial::locate(const std::string &configured, std::string &serial, const std::string &sysfs)
+{
+    if (serial.empty())
+    {
+        serial = UsbSerial::serial(configured, sysfs);
+    }
+
+    if (!serial.empty())
+    {
+        return find(serial, sysfs);
+    }
+
+    Node node{};
+    return identify(configured, node) ? configured : std::string{};
+}
+
+void UsbSerial::forget(void)
+{
+    std::scoped_lock lock(mtx);
+    cache.clear();
+}
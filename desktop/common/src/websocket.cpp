@@ -0,0 +1,185 @@
+#include "websocket.h"
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+
+static const char GUID[]{"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"};
+
+static uint32_t rotate(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// SHA-1 is only used for the handshake accept key, as required by RFC 6455.
+static void sha1(const std::string &input, uint8_t digest[20])
+{
+    uint32_t h[5]{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    std::vector<uint8_t> message(input.begin(), input.end());
+    uint64_t bit_length{static_cast<uint64_t>(message.size()) * 8};
+
+    message.push_back(0x80);
+    while (message.size() % 64 != 56)
+    {
+        message.push_back(0);
+    }
+    for (int i = 7; i >= 0; i--)
+    {
+        message.push_back((bit_length >> (8 * i)) & 0xFF);
+    }
+
+    for (size_t chunk = 0; chunk < message.size(); chunk += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+        {
+            const uint8_t *p{&message[chunk + 4 * i]};
+            w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        }
+        for (int i = 16; i < 80; i++)
+        {
+            w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            uint32_t temp{rotate(a, 5) + f + e + k + w[i]};
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (int i = 0; i < 5; i++)
+    {
+        digest[4 * i] = h[i] >> 24;
+        digest[4 * i + 1] = h[i] >> 16;
+        digest[4 * i + 2] = h[i] >> 8;
+        digest[4 * i + 3] = h[i];
+    }
+}
+
+static std::string base64(const uint8_t *data, size_t length)
+{
+    static const char table[]{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
+    std::string out;
+
+    for (size_t i = 0; i < length; i += 3)
+    {
+        uint32_t group{static_cast<uint32_t>(data[i]) << 16};
+        if (i + 1 < length)
+        {
+            group |= data[i + 1] << 8;
+        }
+        if (i + 2 < length)
+        {
+            group |= data[i + 2];
+        }
+
+        out.push_back(table[(group >> 18) & 0x3F]);
+        out.push_back(table[(group >> 12) & 0x3F]);
+        out.push_back(i + 1 < length ? table[(group >> 6) & 0x3F] : '=');
+        out.push_back(i + 2 < length ? table[group & 0x3F] : '=');
+    }
+
+    return out;
+}
+
+// Value of a header field, header names are case-insensitive.
+static std::string header_value(const std::string &request, const std::string &name)
+{
+    std::string lower{request};
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+
+    size_t start{lower.find("\r\n" + name + ":")};
+    if (start == std::string::npos)
+    {
+        return {};
+    }
+
+    start += name.size() + 3;
+    size_t end{request.find("\r\n", start)};
+
+    std::string value{request.substr(start, end - start)};
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t") + 1);
+    return value;
+}
+
+std::string WebSocket::handshake(const std::string &request)
+{
+    std::string key{header_value(request, "sec-websocket-key")};
+
+    if (request.compare(0, 4, "GET ") != 0 || key.empty())
+    {
+        return {};
+    }
+
+    uint8_t digest[20];
+    sha1(key + GUID, digest);
+
+    return "HTTP/1.1 101 Switching Protocols\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Accept: " +
+           base64(digest, sizeof(digest)) + "\r\n\r\n";
+}
+
+void WebSocket::frame(Opcode opcode, const uint8_t *payload, size_t length, std::vector<uint8_t> &out)
+{
+    out.push_back(0x80 | static_cast<uint8_t>(opcode)); // FIN, no fragmentation
+
+    if (length < 126)
+    {
+        out.push_back(length);
+    }
+    else if (length <= 0xFFFF)
+    {
+        out.push_back(126);
+        out.push_back(length >> 8);
+        out.push_back(length & 0xFF);
+    }
+    else
+    {
+        out.push_back(127);
+        for (int i = 7; i >= 0; i--)
+        {
+            out.push_back((static_cast<uint64_t>(length) >> (8 * i)) & 0xFF);
+        }
+    }
+
+    out.insert(out.end(), payload, payload + length);
+}
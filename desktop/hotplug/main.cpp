@@ -0,0 +1,79 @@
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include "hotplug.h"
+
+// Checks Hotplug with synthetic uevents on the path the kernel's take: parsing, the subsystem
+// filter, udev's own messages and wake(). Real uevents may arrive meanwhile if netlink is
+// available, the checks use device names no real device has. Exits non-zero if a check fails.
+
+static int failed{0};
+
+static void check(bool passed, const char *what)
+{
+    std::printf("%s: %s\n", passed ? "ok" : "FAIL", what);
+    failed += passed ? 0 : 1;
+}
+
+// A uevent as the kernel sends it: the header and KEY=VALUE entries, each NUL-terminated.
+static std::string uevent(const std::string &action, const std::string &subsystem, const std::string &devname)
+{
+    std::string name{devname.substr(devname.rfind('/') + 1)};
+    std::string message{action + "@/devices/virtual/" + subsystem + "/" + name};
+    message += std::string(1, '\0') + "ACTION=" + action;
+    message += std::string(1, '\0') + "DEVPATH=/devices/virtual/" + subsystem + "/" + name;
+    message += std::string(1, '\0') + "SUBSYSTEM=" + subsystem;
+    if (!devname.empty())
+    {
+        message += std::string(1, '\0') + "DEVNAME=" + devname;
+    }
+    message += std::string(1, '\0') + "SEQNUM=4711";
+    return message + std::string(1, '\0');
+}
+
+int main(void)
+{
+    Hotplug hotplug{"tty"};
+    Hotplug::Event event;
+
+    std::printf("hotplugcheck: kernel events %s\n", hotplug.listening() ? "on" : "off, injected ones only");
+
+    check(!hotplug.wait(0, event), "nothing pending, wait(0) returns false");
+
+    hotplug.inject(uevent("add", "tty", "ttyCHECK0"));
+    check(hotplug.wait(100, event) && event.action == Hotplug::Action::ADD && event.subsystem == "tty" && event.device == "/dev/ttyCHECK0",
+          "add with a relative DEVNAME is an ADD of /dev/ttyCHECK0");
+
+    hotplug.inject(uevent("remove", "tty", "/dev/ttyCHECK1"));
+    check(hotplug.wait(100, event) && event.action == Hotplug::Action::REMOVE && event.device == "/dev/ttyCHECK1",
+          "remove with an absolute DEVNAME is a REMOVE of /dev/ttyCHECK1");
+
+    hotplug.inject(uevent("change", "tty", "ttyCHECK2"));
+    check(hotplug.wait(100, event) && event.action == Hotplug::Action::OTHER && event.device == "/dev/ttyCHECK2",
+          "change is OTHER");
+
+    // Skipped without ending the wait, the tty event behind them is the one returned.
+    std::string udev{"libudev"};
+    udev += std::string(1, '\0') + "\xfe\xed\xca\xfe" + uevent("add", "tty", "ttyCHECK3");
+    hotplug.inject(udev);
+    hotplug.inject(uevent("add", "block", "sdCHECK"));
+    hotplug.inject(uevent("remove", "tty", "ttyCHECK4"));
+    check(hotplug.wait(100, event) && event.action == Hotplug::Action::REMOVE && event.device == "/dev/ttyCHECK4",
+          "udev messages and other subsystems are skipped");
+    check(!hotplug.wait(0, event), "nothing left after the skipped ones");
+
+    hotplug.inject(uevent("add", "tty", ""));
+    check(hotplug.wait(100, event) && event.action == Hotplug::Action::ADD && event.device.empty(), "an event without DEVNAME has no device");
+
+    hotplug.wake();
+    check(!hotplug.wait(1000, event), "wake() ends a wait with false");
+
+    std::string header{"add@/devices/virtual/tty/ttyCHECK5"};
+    check(!Hotplug::parse(header.c_str(), header.size() + 1, event), "a header without ACTION= is no uevent");
+
+    std::string plain{"ACTION=add"};
+    check(!Hotplug::parse(plain.c_str(), plain.size() + 1, event), "a message without a header is no uevent");
+
+    std::printf("hotplugcheck: %s\n", (failed == 0) ? "passed" : "FAILED");
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,146 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include "protocol.h"
+#include "clocksync.h"
+#include "statistics.h"
+#include "broadcaster.h"
+#include "framing.h"
+#include "bridge.h"
+#include "serialport.h"
+
+/**
+ * @brief Headless fan-out of one upstream source (server, relay or UART) to many downstream clients
+ *
+ * Frames are forwarded with their original sequence number and timestamp, only the hop count is
+ * incremented. Downstream clock pings are answered on the origin server's clock, so clients behind
+ * any number of relays measure the latency from the origin. Everything runs on one epoll loop.
+ */
+class Relay
+{
+public:
+    struct Upstream
+    {
+        bool uart{false};
+        std::string host{Setting::TCPIP::IP}; // TCP: server or relay to subscribe to
+        int port{Setting::TCPIP::PORT};
+        std::string device{CLIENT_PORT}; // UART: serial device of the client ESP32
+    };
+
+private:
+    Upstream upstream;
+    int upfd{-1};
+    int epfd{-1};
+    bool connecting{false};
+
+    Broadcaster downstream;
+    ClockSync clock;
+    Protocol::Parser parser;
+    RollingPercentile hop_latency{4096};
+
+    // UART frames carry no header, the relay stamps them itself.
+    SerialPort uart;
+    framing_decoder_t uart_decoder{};
+    uint32_t uart_sequence{0};
+    int32_t uart_newest{-1}; // seq of the newest frame through the ESP32 bridges, see bridge_overtaken()
+    uint64_t uart_heard{0};  // When the last frame was read
+
+    // Newest values of all signals per channel, downstream clients that missed updates get them as a keyframe.
+    std::vector<Protocol::Data> state = std::vector<Protocol::Data>(Setting::CHANNELS, Protocol::Data{});
+
+    // Messages of one upstream read, sent downstream together as one frame.
+    std::shared_ptr<std::vector<uint8_t>> batch;
+    std::vector<uint8_t> coverage;
+
+    uint64_t next_connect{0};
+    uint64_t next_ping{0};
+    uint64_t next_report{0};
+    uint64_t forwarded{0};
+    uint8_t hop{0};
+
+    /**
+     * @brief Start connecting or opening the upstream
+     *
+     */
+    void connect_upstream(void);
+
+    /**
+     * @brief Close the upstream and retry after an interval
+     *
+     */
+    void disconnect_upstream(void);
+
+    /**
+     * @brief Read everything available from the upstream and forward the frames
+     *
+     */
+    void read_upstream(void);
+
+    /**
+     * @brief Add a frame to the batch for the downstream clients
+     *
+     * @param data The frame, its hop count is incremented. Unknown channels are dropped.
+     */
+    void forward(Protocol::Data &data);
+
+    /**
+     * @brief Add an update to the batch for the downstream clients
+     *
+     * @param update The update, its hop count is incremented. Unknown channels are dropped.
+     */
+    void forward(Protocol::Update &update);
+
+    /**
+     * @brief Send the batch to all downstream clients and record the time it spent in this relay
+     *
+     * @param received When the batch was read from the upstream
+     */
+    void publish(uint64_t received);
+
+    /**
+     * @brief Answer clock pings from downstream clients on the origin clock
+     *
+     */
+    void on_message(int session, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received);
+
+    /**
+     * @brief Convert the local clock to the clock the forwarded timestamps are on
+     *
+     * @param local Protocol::now() value
+     * @return Origin clock value
+     */
+    uint64_t origin_time(uint64_t local) const;
+
+    /**
+     * @brief Print the latency this hop adds
+     *
+     */
+    void report(void);
+
+public:
+    /**
+     * @brief Constructor for Relay object
+     *
+     * @param upstream Where to receive frames from
+     * @param port     TCP port downstream clients connect to
+     */
+    Relay(const Upstream &upstream, int port);
+
+    /**
+     * @brief Destructor for Relay object
+     *
+     */
+    ~Relay();
+
+    /**
+     * @brief Run the event loop until stop becomes true
+     *
+     * @param stop Set from a signal handler to end the loop
+     */
+    void run(const std::atomic<bool> &stop);
+};
+
+#endif
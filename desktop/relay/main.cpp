@@ -0,0 +1,75 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <sys/resource.h>
+#include "relay.h"
+
+static std::atomic<bool> stop{false};
+
+static void on_signal(int)
+{
+    stop = true;
+}
+
+static void usage(const char *name)
+{
+    std::printf("Usage: %s [--tcp HOST[:PORT] | --uart DEVICE] [--port PORT]\n"
+                "  --tcp   Subscribe to a server or another relay (default %s:%d)\n"
+                "  --uart  Read frames from the client ESP32 instead\n"
+                "  --port  Port downstream clients connect to (default %d)\n",
+                name, Setting::TCPIP::IP, Setting::TCPIP::PORT, Setting::RELAY::PORT);
+}
+
+int main(int argc, char **argv)
+{
+    Relay::Upstream upstream;
+    int port{Setting::RELAY::PORT};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--tcp") && i + 1 < argc)
+        {
+            upstream.uart = false;
+            upstream.host = argv[++i];
+
+            size_t colon = upstream.host.find(':');
+            if (colon != std::string::npos)
+            {
+                upstream.port = std::atoi(upstream.host.c_str() + colon + 1);
+                upstream.host.resize(colon);
+            }
+        }
+        else if (0 == strcmp(argv[i], "--uart") && i + 1 < argc)
+        {
+            upstream.uart = true;
+            upstream.device = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "--port") && i + 1 < argc)
+        {
+            port = std::atoi(argv[++i]);
+        }
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Every downstream client is a file descriptor, allow as many as the system permits.
+    rlimit limit{};
+    if (0 == getrlimit(RLIMIT_NOFILE, &limit))
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    Relay relay(upstream, port);
+    relay.run(stop);
+
+    return EXIT_SUCCESS;
+}
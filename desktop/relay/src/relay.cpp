@@ -0,0 +1,376 @@
+#include "relay.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+constexpr uint64_t MILLISECOND{1000000};
+
+Relay::Relay(const Upstream &upstream, int port)
+    : upstream{upstream},
+      downstream{port, [this](int session, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received)
+                 { on_message(session, type, payload, length, received); }}
+{
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+
+    for (size_t channel = 0; channel < state.size(); channel++)
+    {
+        state[channel].channel = channel;
+    }
+}
+
+Relay::~Relay()
+{
+    if (upfd >= 0 && !upstream.uart)
+    {
+        close(upfd);
+    }
+    close(epfd);
+}
+
+void Relay::connect_upstream(void)
+{
+    if (upstream.uart)
+    {
+        // Raw at BAUDRATE, the port polls readable once a whole frame is buffered.
+        bool opened{uart.open(upstream.device, BAUDRATE, O_RDONLY, FRAMING_ENCODED_LEN(BUFLEN))};
+        upfd = opened ? uart.descriptor() : -1;
+        framing_reset(&uart_decoder);
+        uart_newest = -1;
+    }
+    else
+    {
+        upfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_IP);
+
+        if (upfd >= 0)
+        {
+            int optval = 1;
+            setsockopt(upfd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+            sockaddr_in servaddr{};
+            servaddr.sin_family = AF_INET;
+            servaddr.sin_port = htons(upstream.port);
+            servaddr.sin_addr.s_addr = inet_addr(upstream.host.c_str());
+
+            // Completion of the non-blocking connect is signalled by EPOLLOUT.
+            if (0 != connect(upfd, (sockaddr *)&servaddr, sizeof(servaddr)) && errno != EINPROGRESS)
+            {
+                close(upfd);
+                upfd = -1;
+            }
+        }
+    }
+
+    if (upfd < 0)
+    {
+        next_connect = Protocol::now() + Setting::INTERVAL * MILLISECOND;
+        return;
+    }
+
+    connecting = !upstream.uart;
+    parser.reset();
+    clock.reset();
+
+    epoll_event event{};
+    event.events = connecting ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.fd = upfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, upfd, &event);
+}
+
+void Relay::disconnect_upstream(void)
+{
+    if (!connecting)
+    {
+        std::printf("relay: lost upstream, reconnecting\n");
+    }
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, upfd, nullptr);
+    if (upstream.uart)
+    {
+        uart.close();
+    }
+    else
+    {
+        close(upfd);
+    }
+    upfd = -1;
+    connecting = false;
+    next_connect = Protocol::now() + Setting::INTERVAL * MILLISECOND;
+}
+
+void Relay::read_upstream(void)
+{
+    uint8_t buffer[4096];
+
+    while (upfd >= 0)
+    {
+        ssize_t bytes_read{read(upfd, buffer, sizeof(buffer))};
+        uint64_t received{Protocol::now()};
+
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else if (bytes_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (bytes_read <= 0)
+        {
+            disconnect_upstream();
+            break;
+        }
+
+        if (upstream.uart)
+        {
+            // The server ESP32 may have restarted during a silence and counts its seq from 0 again.
+            if (received - uart_heard > Setting::UART::LIVENESS_TIMEOUT * MILLISECOND)
+            {
+                uart_newest = -1;
+            }
+
+            // COBS frames of BUFLEN bytes, stamped with the relay's clock. Damaged ones are dropped. Through
+            // the ESP32 bridges a frame carries its seq, one an urgent frame overtook is older state.
+            for (ssize_t i = 0; i < bytes_read; i++)
+            {
+                int size{framing_feed(&uart_decoder, buffer[i])};
+
+                if (size == BUFLEN || (size == BRIDGE_TAGGED_LEN && !bridge_overtaken(uart_decoder.data, &uart_newest)))
+                {
+                    uart_heard = received;
+                    Protocol::Data data{};
+                    data.sequence = uart_sequence++;
+                    data.timestamp = received;
+                    memcpy(data.payload, uart_decoder.data, BUFLEN);
+                    forward(data);
+                    publish(received);
+                }
+            }
+            continue;
+        }
+
+        parser.feed(buffer, bytes_read, [&](Protocol::Type type, const uint8_t *payload, size_t length)
+                    {
+            if (type == Protocol::Type::DATA)
+            {
+                Protocol::Data data;
+                if (Protocol::decode(payload, length, data))
+                {
+                    forward(data);
+                }
+            }
+            else if (type == Protocol::Type::UPDATE)
+            {
+                Protocol::Update update;
+                if (Protocol::decode(payload, length, update))
+                {
+                    forward(update);
+                }
+            }
+            else if (type == Protocol::Type::PONG)
+            {
+                Protocol::Pong pong;
+                if (Protocol::decode(payload, length, pong))
+                {
+                    clock.add(pong, received);
+                }
+            } });
+
+        publish(received);
+    }
+}
+
+void Relay::forward(Protocol::Data &data)
+{
+    if (data.channel >= state.size())
+    {
+        return;
+    }
+
+    data.hops++;
+    hop = data.hops;
+    state[data.channel] = data;
+
+    if (batch == nullptr)
+    {
+        batch = std::make_shared<std::vector<uint8_t>>();
+    }
+    Protocol::encode(data, *batch);
+
+    // All signals of the channel.
+    Protocol::cover(coverage, data.channel, std::vector<uint8_t>((Setting::Signal::handle().size() + 7) / 8, 0xFF));
+    forwarded++;
+}
+
+void Relay::forward(Protocol::Update &update)
+{
+    if (update.channel >= state.size())
+    {
+        return;
+    }
+
+    update.hops++;
+    hop = update.hops;
+
+    Protocol::Data &channel = state[update.channel];
+    Protocol::apply(update, channel.payload);
+    channel.sequence = update.sequence;
+    channel.timestamp = update.timestamp;
+    channel.hops = update.hops;
+
+    if (batch == nullptr)
+    {
+        batch = std::make_shared<std::vector<uint8_t>>();
+    }
+    Protocol::encode(update, *batch);
+    Protocol::cover(coverage, update.channel, update.signals);
+    forwarded++;
+}
+
+void Relay::publish(uint64_t received)
+{
+    if (batch == nullptr)
+    {
+        return;
+    }
+
+    // Serialized once, shared by every downstream session.
+    auto signals = std::make_shared<const std::vector<uint8_t>>(std::move(coverage));
+    downstream.broadcast(batch, signals, [this]()
+                         {
+        auto keyframe = std::make_shared<std::vector<uint8_t>>();
+        for (const auto &channel : state)
+        {
+            Protocol::encode(channel, *keyframe);
+        }
+        return Broadcaster::Frame{keyframe}; });
+
+    batch = nullptr;
+    coverage.clear();
+    hop_latency.add(static_cast<int64_t>(Protocol::now() - received) / 1000);
+}
+
+void Relay::on_message(int session, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received)
+{
+    Protocol::Ping ping;
+
+    // Until the relay itself is synchronized it cannot give the origin time, so the ping goes unanswered.
+    if (type == Protocol::Type::PING && Protocol::decode(payload, length, ping) && (upstream.uart || clock.synchronized()))
+    {
+        auto pong = std::make_shared<std::vector<uint8_t>>();
+        Protocol::encode(Protocol::Pong{ping.origin, origin_time(received), origin_time(Protocol::now())}, *pong);
+        downstream.send(session, pong);
+    }
+}
+
+uint64_t Relay::origin_time(uint64_t local) const
+{
+    return upstream.uart ? local : clock.toServer(local);
+}
+
+void Relay::report(void)
+{
+    std::printf("relay hop %u: %zu clients, %llu frames, added latency p50 %lld us, p99 %lld us, max %lld us, "
+                "worst queue delay urgent %lld us, normal %lld us, bulk %lld us\n",
+                hop, downstream.size(), static_cast<unsigned long long>(forwarded),
+                static_cast<long long>(hop_latency.percentile(50)),
+                static_cast<long long>(hop_latency.percentile(99)),
+                static_cast<long long>(hop_latency.percentile(100)),
+                static_cast<long long>(downstream.delay(Setting::URGENT).max()),
+                static_cast<long long>(downstream.delay(Setting::NORMAL).max()),
+                static_cast<long long>(downstream.delay(Setting::BULK).max()));
+
+    if (upstream.uart)
+    {
+        std::printf("relay hop %u: UART frames %u good, %u damaged\n", hop,
+                    static_cast<unsigned>(uart_decoder.good), static_cast<unsigned>(uart_decoder.bad));
+    }
+    std::fflush(stdout);
+}
+
+void Relay::run(const std::atomic<bool> &stop)
+{
+    bool listening{false};
+    epoll_event events[256];
+
+    next_report = Protocol::now() + Setting::RELAY::REPORT_INTERVAL * MILLISECOND;
+
+    while (!stop)
+    {
+        uint64_t now{Protocol::now()};
+
+        if (!listening)
+        {
+            listening = downstream.attach(epfd);
+        }
+
+        if (upfd < 0 && now >= next_connect)
+        {
+            connect_upstream();
+        }
+
+        // Keep the clock estimate towards the upstream fresh.
+        if (upfd >= 0 && !connecting && !upstream.uart && now >= next_ping)
+        {
+            std::vector<uint8_t> message;
+            Protocol::encode(Protocol::Ping{now}, message);
+
+            if (static_cast<ssize_t>(message.size()) != send(upfd, message.data(), message.size(), MSG_NOSIGNAL))
+            {
+                ; // A lost connection is detected by the next read.
+            }
+            next_ping = now + Setting::SYNC_INTERVAL * MILLISECOND;
+        }
+
+        downstream.expire(now, Setting::CONTROL::KEEPALIVE_TIMEOUT * MILLISECOND);
+
+        if (now >= next_report)
+        {
+            report();
+            next_report = now + Setting::RELAY::REPORT_INTERVAL * MILLISECOND;
+        }
+
+        int count{epoll_wait(epfd, events, 256, Setting::INTERVAL)};
+
+        for (int i = 0; i < count; i++)
+        {
+            int fd{events[i].data.fd};
+
+            if (fd != upfd)
+            {
+                downstream.handle(fd, events[i].events);
+            }
+            else if (connecting && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            {
+                int error{0};
+                socklen_t len = sizeof(error);
+                getsockopt(upfd, SOL_SOCKET, SO_ERROR, &error, &len);
+
+                if (error != 0)
+                {
+                    disconnect_upstream();
+                    continue;
+                }
+
+                std::printf("relay: subscribed to %s:%d\n", upstream.host.c_str(), upstream.port);
+                connecting = false;
+                next_ping = 0; // Synchronize right away
+
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.fd = upfd;
+                epoll_ctl(epfd, EPOLL_CTL_MOD, upfd, &event);
+            }
+            else if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                read_upstream();
+            }
+        }
+    }
+}
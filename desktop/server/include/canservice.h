@@ -0,0 +1,45 @@
+#ifndef CANSERVICE_H
+#define CANSERVICE_H
+
+#include "comservice.h"
+#include <thread>
+#include <unistd.h>
+
+class CANService : public COMService
+{
+    int sockfd{-1};
+    std::atomic<bool> server_window_closed{false};
+    std::thread trd{&CANService::run, this};
+
+    /**
+     * @brief Opens and binds a raw CAN socket on Setting::CAN::INTERFACE
+     *
+     * @return true if the socket is ready to send frames
+     */
+    bool open_socket(void);
+
+    /**
+     * @brief Override of base class run function
+     *
+     */
+    void run(void) override;
+
+public:
+    /**
+     * @brief Constructor for CANService object
+     *
+     */
+    CANService() = default;
+
+    /**
+     * @brief Destructor for CANService object
+     *
+     */
+    ~CANService()
+    {
+        server_window_closed = true;
+        trd.join();
+    }
+};
+
+#endif
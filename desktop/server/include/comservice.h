@@ -2,9 +2,13 @@
 #define COMSERVICE_H
 
 #include <mutex>
+#include <vector>
 #include <atomic>
 #include <cstdint>
 #include "setting.h"
+#include "protocol.h"
+#include "statistics.h"
+#include "sendclock.h"
 
 class COMService
 {
@@ -21,13 +25,74 @@ private:
      * @param start_bit Start-position in the buffer
      * @param length    How many bits the value occupies in the buffer
      * @param value     The value that is to be inserted in the buffer
+     * @param channel   The vehicle, out of range is ignored
      */
-    void insert_data(const uint32_t start_bit, const uint32_t length, uint32_t value);
+    void insert_data(const uint32_t start_bit, const uint32_t length, uint32_t value, uint16_t channel);
+
+    uint32_t sequence{0};
 
 protected:
+    /**
+     * @brief State of one vehicle, both copies side by side so checking for changes touches one cache line
+     * 
+     */
+    struct Channel
+    {
+        uint8_t buffer[BUFLEN]; // Newest values
+        uint8_t sent[BUFLEN];   // The values as last sent in an update, unchanged signals are left out of the next one
+    };
+
     std::mutex mtx;
-    uint8_t buffer[BUFLEN]{};
+
+    /**
+     * @brief All vehicles, indexed by channel ID. UART and CAN frames only have room for channel 0.
+     * 
+     */
+    std::vector<Channel> channels = std::vector<Channel>(Setting::CHANNELS, Channel{});
     std::atomic<bool> status{false};
+    std::atomic<size_t> clients{0};
+
+    /**
+     * @brief Render latency reported by the clients' acks, in microseconds
+     * 
+     */
+    RollingPercentile client_latency;
+
+    /**
+     * @brief Paces the send loop of the transport and records its jitter
+     * 
+     */
+    SendClock send_clock;
+
+    /**
+     * @brief Switch the calling send thread to SCHED_FIFO if Setting::SEND_PRIORITY asks for it
+     * 
+     */
+    void prioritize(void);
+
+    /**
+     * @brief Copy the newest values of all channels
+     * 
+     * @param out Channel after channel, Setting::CHANNELS * BUFLEN bytes
+     */
+    void sample(uint8_t *out);
+
+    /**
+     * @brief Serialize a keyframe of every channel, each with the next sequence number and the current time
+     * 
+     * @param frame One DATA message per channel is appended here
+     */
+    void snapshot(std::vector<uint8_t> &frame);
+
+    /**
+     * @brief Serialize an update for every channel whose due signals changed since they were last sent
+     * 
+     * @param signals  Bitmap of the signals that are due, see Protocol::Update
+     * @param frame    One UPDATE message per changed channel is appended here
+     * @param coverage Set to the signals of all channels in the frame, see Protocol::cover()
+     * @return false if none of the due signals changed, nothing needs to be sent
+     */
+    bool update(const std::vector<uint8_t> &signals, std::vector<uint8_t> &frame, std::vector<uint8_t> &coverage);
 
     /**
      * @brief Pure Virutal function to be implemented in other file
@@ -40,36 +105,71 @@ public:
      * @brief Function to set the value for the battery
      * 
      * @param value The value to be sett
+     * @param channel The vehicle
      */
-    void setBatteryLevel(uint32_t value);
+    void setBatteryLevel(uint32_t value, uint16_t channel = 0);
 
     /**
      * @brief Function to set the value for the temperature
      *
      * @param value The value to be sett
+     * @param channel The vehicle
      */
-    void setTemperature(int32_t value);
+    void setTemperature(int32_t value, uint16_t channel = 0);
 
     /**
      * @brief Function to set the value for the left blinker light
      *
      * @param value The value to be sett
+     * @param channel The vehicle
      */
-    void setLeftLight(bool value);
+    void setLeftLight(bool value, uint16_t channel = 0);
 
     /**
      * @brief Function to set the value for the right blinker light
      *
      * @param value The value to be sett
+     * @param channel The vehicle
      */
-    void setRightLight(bool value);
+    void setRightLight(bool value, uint16_t channel = 0);
 
     /**
      * @brief Function to set the value for the speed
      *
      * @param value The value to be sett
+     * @param channel The vehicle
+     */
+    void setSpeed(uint32_t value, uint16_t channel = 0);
+
+    /**
+     * @brief Get the number of connected clients
+     *
+     * @return Clients on the TCP and WebSocket endpoints, always 0 for UART and CAN
+     */
+    size_t getClients(void) { return clients; }
+
+    /**
+     * @brief Get the latency from sending a frame to a client rendering it, as reported by the clients
+     *
+     * @param percentile Percentile over the recent acks, range 0 - 100
+     * @return Latency in microseconds, 0 if no client acknowledges frames
+     */
+    uint32_t getClientLatency(double percentile);
+
+    /**
+     * @brief Get the histogram of how late frames were sent compared to their schedule
+     *
+     * @return Jitter in microseconds, filled while the service runs
+     */
+    const Histogram &getJitter(void) { return send_clock.jitter; }
+
+    /**
+     * @brief Get the longest time a frame of a priority waited behind other frames before it was sent
+     *
+     * @param priority The priority of the frames
+     * @return Delay in microseconds, 0 for transports without queues
      */
-    void setSpeed(uint32_t value);
+    virtual int64_t getWorstDelay(Setting::Priority priority) { (void)priority; return 0; }
 
     /**
      * @brief Destructor for the COMService object
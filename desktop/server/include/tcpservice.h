@@ -2,39 +2,78 @@
 #define TCPCOM_H
 
 #include "comservice.h"
+#include "broadcaster.h"
+#include "history.h"
 #include <thread>
-#include <unistd.h>
-#include <sys/socket.h>
 
-    
+
 class TCPService : public COMService
 {
-    int sockfd;
     std::atomic<bool> server_window_closed{false};
+
+    /**
+     * @brief Fan-out to all connected clients, also answers their clock pings and control messages
+     *
+     */
+    Broadcaster broadcaster{Setting::TCPIP::PORT, [this](int session, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received)
+                            { on_message(session, type, payload, length, received, broadcaster); }};
+
+    /**
+     * @brief The same frames for browsers, as binary WebSocket messages
+     *
+     */
+    Broadcaster websocket{Setting::TCPIP::WEBSOCKET_PORT, [this](int session, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received)
+                          { on_message(session, type, payload, length, received, websocket); },
+                          Broadcaster::Framing::WEBSOCKET};
+
+    /**
+     * @brief The last Setting::HISTORY::SECONDS of all channels, sent to clients that ask for a backfill
+     *
+     */
+    History history{Setting::CHANNELS, Setting::HISTORY::SECONDS * 1000 / Setting::HISTORY::INTERVAL, Setting::HISTORY::INTERVAL * 1000000ull};
+
     std::thread trd{&TCPService::run, this};
 
+    /**
+     * @brief Handle a message sent by a client
+     *
+     * @param session  The client that sent it
+     * @param type     Message type
+     * @param payload  Message payload
+     * @param length   Payload length
+     * @param received When the message was read
+     * @param origin   The endpoint the client is connected to
+     */
+    void on_message(int session, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received, Broadcaster &origin);
+
     /**
      * @brief Override of base class run function
-     * 
+     *
      */
     void run(void) override;
 
 public:
     /**
      * @brief Constructor for TCPService object
-     * 
+     *
      */
     TCPService() = default;
 
+    /**
+     * @brief Get the longest time a frame waited in a client's queue, over all clients
+     *
+     * @param priority The queue
+     * @return Delay in microseconds
+     */
+    int64_t getWorstDelay(Setting::Priority priority) override;
+
     /**
      * @brief Destructor for TCPService object
-     * 
+     *
      */
     ~TCPService()
     {
         server_window_closed = true;
-        shutdown(sockfd, SHUT_RDWR);
-        close(sockfd);
         trd.join();
     }
 };
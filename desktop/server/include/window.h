@@ -2,6 +2,7 @@
 #define WINDOW_H
 
 #include <QLabel>
+#include <QTimer>
 #include <QDialog>
 #include <QAbstractSlider>
 #include <QSlider>
@@ -80,6 +81,10 @@ private:
     QLabel labelTempTitle{"Temperature:"};
     QLabel labelBatteryTitle{"Battery:"};
 
+    QLabel labelStatus;
+    QLabel labelJitter;
+    QTimer status_timer;
+
 protected:
     /**
      * @brief Overrides the closeEvent virtual function from QWidget
@@ -7,8 +7,11 @@
 #elif defined(COMM_PROTOCOL_TCP)
 #include "tcpservice.h"
 
+#elif defined(COMM_PROTOCOL_CAN)
+#include "canservice.h"
+
 #else
-#error "One of COMM_PROTOCOL_UART or COMM_PROTOCOL_TCP must be defined"
+#error "One of COMM_PROTOCOL_UART, COMM_PROTOCOL_TCP or COMM_PROTOCOL_CAN must be defined"
 #endif
 
 void Window::closeEvent(QCloseEvent *event)
@@ -24,6 +27,9 @@ int main(int argc, char **argv)
 #elif defined(COMM_PROTOCOL_TCP)
     TCPService comms;
 
+#elif defined(COMM_PROTOCOL_CAN)
+    CANService comms;
+
 #endif
 
     QApplication app(argc, argv);
@@ -0,0 +1,114 @@
+#include "canservice.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+static_assert(BUFLEN <= CAN_MAX_DLEN, "The signal frame must fit in a classic CAN frame");
+
+bool CANService::open_socket(void)
+{
+    sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+    if (sockfd < 0)
+    {
+        return false;
+    }
+
+    // Resolve the interface index of e.g. vcan0/can0
+    ifreq ifr{};
+    strncpy(ifr.ifr_name, Setting::CAN::INTERFACE, IFNAMSIZ - 1);
+
+    bool ready{0 == ioctl(sockfd, SIOCGIFINDEX, &ifr)};
+
+    // The server only transmits, so drop everything the bus sends back to us.
+    if (ready)
+    {
+        ready = (0 == setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, nullptr, 0));
+    }
+
+    if (ready && Setting::CAN::FD)
+    {
+        int enable{1};
+        ready = (0 == setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)));
+    }
+
+    if (ready)
+    {
+        sockaddr_can addr{};
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = ifr.ifr_ifindex;
+        ready = (0 == bind(sockfd, (sockaddr *)&addr, sizeof(addr)));
+    }
+
+    if (!ready)
+    {
+        close(sockfd);
+        sockfd = -1;
+    }
+
+    return ready;
+}
+
+void CANService::run(void)
+{
+    canfd_frame frame{}; // A classic can_frame is layout compatible with the first CAN_MTU bytes
+    frame.can_id = Setting::CAN::ID;
+    frame.len = BUFLEN;
+
+    const size_t mtu{Setting::CAN::FD ? CANFD_MTU : CAN_MTU};
+
+    prioritize();
+    send_clock.arm(Protocol::now() + Setting::INTERVAL * 1000000ull);
+
+    while (false == server_window_closed)
+    {
+        // Absolute deadlines, the time spent writing does not add to the period.
+        send_clock.wait();
+        send_clock.advance(Setting::INTERVAL * 1000000ull);
+
+        if (sockfd < 0)
+        {
+            // Interface missing or down, retry every interval
+            if (!open_socket())
+            {
+                status = false;
+                continue;
+            }
+        }
+
+        {
+            std::scoped_lock lock{mtx};
+            memcpy(frame.data, channels[0].buffer, BUFLEN); // The frame has no room for a channel ID
+        }
+
+        ssize_t bytes_written{write(sockfd, &frame, mtu)};
+
+        if (static_cast<ssize_t>(mtu) == bytes_written)
+        {
+            status = true;
+            send_clock.sent();
+        }
+        else if (errno == ENOBUFS)
+        {
+            ; // TX queue is full for a moment, the next interval sends the latest values anyway
+        }
+        else
+        {
+            std::cout << "Server lost the CAN interface " << Setting::CAN::INTERFACE << std::endl;
+            status = false;
+            close(sockfd);
+            sockfd = -1;
+        }
+    }
+
+    if (sockfd >= 0)
+    {
+        close(sockfd);
+    }
+    status = false;
+}
@@ -1,14 +1,23 @@
 #include "comservice.h"
 #include <climits>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
 
-void COMService::insert_data(const uint32_t start_bit, const uint32_t length, uint32_t value)
+void COMService::insert_data(const uint32_t start_bit, const uint32_t length, uint32_t value, uint16_t channel)
 {
     uint32_t bytePosition{start_bit / CHAR_BIT};
     uint32_t bitPosition{start_bit % CHAR_BIT};
 
     int bitValue{0};
 
+    if (channel >= channels.size())
+    {
+        return;
+    }
+
     std::scoped_lock lock(mtx);
+    uint8_t *buffer{channels[channel].buffer};
     for (size_t i = 0; i < length; i++)
     {
         buffer[bytePosition] &= ~(1 << bitPosition); // Clear currently stored bit inside buffer
@@ -26,27 +35,141 @@ void COMService::insert_data(const uint32_t start_bit, const uint32_t length, ui
     }
 }
 
-void COMService::setBatteryLevel(uint32_t value)
+void COMService::sample(uint8_t *out)
+{
+    std::scoped_lock lock(mtx);
+
+    for (const Channel &channel : channels)
+    {
+        memcpy(out, channel.buffer, BUFLEN);
+        out += BUFLEN;
+    }
+}
+
+void COMService::snapshot(std::vector<uint8_t> &frame)
+{
+    Protocol::Data data{};
+    data.timestamp = Protocol::now();
+
+    std::scoped_lock lock(mtx);
+    frame.reserve(frame.size() + channels.size() * (Protocol::HEADER_LEN + 4 + 8 + 1 + 2 + BUFLEN));
+
+    for (size_t channel = 0; channel < channels.size(); channel++)
+    {
+        memcpy(data.payload, channels[channel].buffer, BUFLEN);
+        data.channel = channel;
+        data.sequence = sequence++;
+        Protocol::encode(data, frame);
+    }
+}
+
+bool COMService::update(const std::vector<uint8_t> &signals, std::vector<uint8_t> &frame, std::vector<uint8_t> &coverage)
+{
+    // The bits of every due signal, the same for all channels.
+    struct Mask
+    {
+        size_t index;
+        uint8_t bits[BUFLEN];
+    };
+    uint8_t due[BUFLEN]{};
+    std::vector<Mask> masks;
+    for (size_t index = 0; index < signal.size() && index / 8 < signals.size(); index++)
+    {
+        if ((signals[index / 8] >> (index % 8)) & 1)
+        {
+            const auto &value = signal[signal.name(index)];
+            Mask &mask = masks.emplace_back(Mask{index, {}});
+
+            for (int bit = value.start; bit < value.start + value.length; bit++)
+            {
+                mask.bits[bit / CHAR_BIT] |= 1 << (bit % CHAR_BIT);
+                due[bit / CHAR_BIT] |= 1 << (bit % CHAR_BIT);
+            }
+        }
+    }
+
+    Protocol::Update update{};
+    update.timestamp = Protocol::now();
+    coverage.clear();
+
+    std::scoped_lock lock(mtx);
+
+    for (size_t channel = 0; channel < channels.size(); channel++)
+    {
+        Channel &state = channels[channel];
+        uint8_t changed[BUFLEN];
+        bool any{false};
+
+        for (size_t i = 0; i < BUFLEN; i++)
+        {
+            changed[i] = (state.buffer[i] ^ state.sent[i]) & due[i];
+            any |= (changed[i] != 0);
+        }
+
+        // Most channels did not change, they cost one compare per byte.
+        if (!any)
+        {
+            continue;
+        }
+
+        update.signals.assign(signals.size(), 0);
+        for (const Mask &mask : masks)
+        {
+            for (size_t i = 0; i < BUFLEN; i++)
+            {
+                if (changed[i] & mask.bits[i])
+                {
+                    update.signals[mask.index / 8] |= 1 << (mask.index % 8);
+                    break;
+                }
+            }
+        }
+
+        Protocol::pack(state.buffer, update);
+        Protocol::apply(update, state.sent);
+        update.channel = channel;
+        update.sequence = sequence++;
+        Protocol::encode(update, frame);
+        Protocol::cover(coverage, update.channel, update.signals);
+    }
+
+    return !coverage.empty();
+}
+
+void COMService::prioritize(void)
+{
+    if (Setting::SEND_PRIORITY > 0 && !SendClock::realtime(Setting::SEND_PRIORITY))
+    {
+        std::cout << "SCHED_FIFO not permitted, sending with normal priority" << std::endl;
+    }
+}
+
+uint32_t COMService::getClientLatency(double percentile)
+{
+    return std::max<int64_t>(0, client_latency.percentile(percentile));
+}
+
+void COMService::setBatteryLevel(uint32_t value, uint16_t channel)
 {
-    insert_data(signal["battery"].start, signal["battery"].length, value);
+    insert_data(signal["battery"].start, signal["battery"].length, value, channel);
 }
 
-void COMService::setTemperature(int32_t value)
+void COMService::setTemperature(int32_t value, uint16_t channel)
 {
-    insert_data(signal["temperature"].start, signal["temperature"].length, value);
+    insert_data(signal["temperature"].start, signal["temperature"].length, value, channel);
 }
 
-void COMService::setLeftLight(bool value)
+void COMService::setLeftLight(bool value, uint16_t channel)
 {
-    insert_data(signal["signal-left"].start, signal["signal-left"].length, value);
+    insert_data(signal["signal-left"].start, signal["signal-left"].length, value, channel);
 }
 
-void COMService::setRightLight(bool value)
+void COMService::setRightLight(bool value, uint16_t channel)
 {
-    insert_data(signal["signal-right"].start, signal["signal-right"].length, value);
+    insert_data(signal["signal-right"].start, signal["signal-right"].length, value, channel);
 }
 
-void COMService::setSpeed(uint32_t value)
+void COMService::setSpeed(uint32_t value, uint16_t channel)
 {
-    insert_data(signal["speed"].start, signal["speed"].length, value);
+    insert_data(signal["speed"].start, signal["speed"].length, value, channel);
 }
\ No newline at end of file
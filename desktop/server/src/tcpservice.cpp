@@ -1,130 +1,219 @@
 #include "tcpservice.h"
-// temporary in testing phase
-#include <netinet/in.h>
-#include <iostream>
-#include <thread>
+#include "timerwheel.h"
+#include <numeric>
 #include <unistd.h>
-#include <sys/socket.h>
-#include <string.h>
+#include <algorithm>
+#include <sys/epoll.h>
+
+constexpr uint64_t MILLISECOND{1000000};
+
+// Timer wheel jobs besides the signals, which use their index.
+constexpr int KEYFRAME{-1};
+constexpr int HISTORY_SAMPLE{-2};
+
+// Back off a client whose renders lag several send periods behind, speed it up again once it has caught up.
+static void adapt(Broadcaster::Control &control)
+{
+    uint64_t period{std::max<uint64_t>(control.interval, Setting::INTERVAL * MILLISECOND)};
+    uint64_t lag{static_cast<uint64_t>(std::max<int64_t>(0, control.latency)) * 1000};
+
+    if (lag > 4 * period)
+    {
+        control.interval = std::min<uint64_t>(2 * period, Setting::CONTROL::MAX_INTERVAL * MILLISECOND);
+    }
+    else if (lag < period && control.interval > control.requested)
+    {
+        control.interval = std::max<uint64_t>(control.requested, control.interval / 2);
+    }
+    else
+    {
+        ;
+    }
+}
+
+void TCPService::on_message(int session, Protocol::Type type, const uint8_t *payload, size_t length, uint64_t received, Broadcaster &origin)
+{
+    Protocol::Ping ping;
+    Protocol::Ack ack;
+    Protocol::History request;
+
+    if (type == Protocol::Type::PING && Protocol::decode(payload, length, ping))
+    {
+        auto pong = std::make_shared<std::vector<uint8_t>>();
+        Protocol::encode(Protocol::Pong{ping.origin, received, Protocol::now()}, *pong);
+        origin.send(session, pong);
+    }
+    else if (type == Protocol::Type::ACK && Protocol::decode(payload, length, ack))
+    {
+        int64_t latency{static_cast<int64_t>(ack.rendered - ack.sent) / 1000};
+        client_latency.add(latency);
+
+        Broadcaster::Control *control{origin.control(session)};
+        if (control != nullptr)
+        {
+            control->latency = (control->latency == 0) ? latency : (7 * control->latency + latency) / 8;
+            adapt(*control);
+        }
+    }
+    else if (type == Protocol::Type::HISTORY && Protocol::decode(payload, length, request))
+    {
+        // Queued ahead of the data frames, so the client has its history before the next live frame.
+        auto backfill = std::make_shared<std::vector<uint8_t>>();
+        history.backfill(request.channel, received - std::min<uint64_t>(received, request.seconds * 1000 * MILLISECOND), *backfill);
+
+        if (!backfill->empty())
+        {
+            origin.send(session, backfill);
+        }
+    }
+}
+
+int64_t TCPService::getWorstDelay(Setting::Priority priority)
+{
+    return std::max(broadcaster.delay(priority).max(), websocket.delay(priority).max());
+}
 
 void TCPService::run(void)
 {
-    int connfd{-1}; // Error for accept.
+    int epfd{epoll_create1(EPOLL_CLOEXEC)};
+    bool listening{false};
+    bool websocket_listening{false};
 
-    uint8_t _buffer[BUFLEN];
+    epoll_event events[64];
 
-    while (false == server_window_closed)
+    // Every signal is sent at its own period, the wheel ticks at the greatest common divisor of them.
+    Setting::Signal &signal{Setting::Signal::handle()};
+    int tick{0};
+    for (size_t index = 0; index < signal.size(); index++)
+    {
+        tick = std::gcd(tick, signal[signal.name(index)].period);
+    }
+
+    tick = std::gcd(tick, Setting::KEYFRAME_INTERVAL);
+    tick = std::gcd(tick, Setting::HISTORY::INTERVAL);
+
+    TimerWheel wheel{static_cast<uint64_t>(std::max(tick, 1)) * MILLISECOND};
+    for (size_t index = 0; index < signal.size(); index++)
     {
-        // Create socket
-        sockfd = -1;
+        wheel.add(index, signal[signal.name(index)].period * MILLISECOND);
+    }
+    wheel.add(KEYFRAME, Setting::KEYFRAME_INTERVAL * MILLISECOND);
+    wheel.add(HISTORY_SAMPLE, Setting::HISTORY::INTERVAL * MILLISECOND);
+    wheel.start(Protocol::now());
+
+    // The wheel's deadlines are absolute, the timer wakes the loop exactly at them.
+    prioritize();
+    send_clock.arm(wheel.deadline());
+
+    epoll_event timer_event{};
+    timer_event.events = EPOLLIN;
+    timer_event.data.fd = send_clock.descriptor();
+    epoll_ctl(epfd, EPOLL_CTL_ADD, send_clock.descriptor(), &timer_event);
 
-        // while sockfd fails to create.
-        while (sockfd == -1)
+    while (false == server_window_closed)
+    {
+        // Retry binding every interval until the port is free.
+        if (!listening)
+        {
+            listening = broadcaster.attach(epfd);
+        }
+        if (!websocket_listening)
         {
-            sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+            websocket_listening = websocket.attach(epfd);
+        }
+
+        // Serve the clients until the send clock fires, retry binding every interval meanwhile.
+        int count{epoll_wait(epfd, events, 64, Setting::INTERVAL)};
 
-            // If socket failed, print a message
-            if (sockfd == -1)
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].data.fd == send_clock.descriptor())
             {
-                ;
+                ; // Handled below
             }
-            else
+            else if (!broadcaster.handle(events[i].data.fd, events[i].events))
             {
-                int optval = 1;
-                setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+                websocket.handle(events[i].data.fd, events[i].events);
             }
-            // whle loop continues until sockfd is valid
         }
 
-        // create instance of sockaddr_in
-        sockaddr_in servaddr{};
+        if (!send_clock.expired())
+        {
+            continue;
+        }
+
+        // Collect the signals that are due, one update per priority so urgent signals can overtake the rest.
+        std::vector<uint8_t> due[Setting::PRIORITIES];
+        bool periodic{false};
+        wheel.advance(Protocol::now(), [&](int index)
+                      {
+            if (index == KEYFRAME)
+            {
+                periodic = true;
+                return;
+            }
+            else if (index == HISTORY_SAMPLE)
+            {
+                sample(history.push(Protocol::now()));
+                return;
+            }
 
-        // Assign IP and PORT
-        servaddr.sin_family = AF_INET;
-        servaddr.sin_port = htons(Setting::TCPIP::PORT);
-        servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+            auto &mask = due[signal[signal.name(index)].priority];
+            mask.resize((signal.size() + 7) / 8);
+            mask[index / 8] |= 1 << (index % 8); });
 
-        // Binding newly created socket to given IP and verification
-        int bind_check{-1};
-        while (0 != bind_check)
+        // Clients that missed updates get all signals, built at most once per tick.
+        Broadcaster::Frame full;
+        auto keyframe = [&]()
         {
-            if (server_window_closed)
+            if (full == nullptr)
             {
-                shutdown(sockfd, SHUT_RDWR);
-                close(sockfd);
-                status = false;
-                return;
+                auto data = std::make_shared<std::vector<uint8_t>>();
+                snapshot(*data);
+                full = data;
             }
-            
-            std::this_thread::sleep_for(std::chrono::milliseconds(Setting::INTERVAL));
-            bind_check = bind(sockfd, (sockaddr *)&servaddr, sizeof(servaddr));
-        }
+            return full;
+        };
 
-        // Listen to only once connection
-        if (0 == listen(sockfd, 1))
+        bool any{false};
+        if (periodic)
         {
-            sockaddr_in cli{};
-            socklen_t len = sizeof(cli);
+            // Everyone gets all signals now and then, in case an update was lost on the way.
+            broadcaster.broadcast(keyframe());
+            websocket.broadcast(keyframe());
+            any = true;
+        }
 
-            // acceptcomservice{comms} and check the connection.
-            connfd = accept(sockfd, (sockaddr *)&cli, &len);
+        for (const auto &mask : due)
+        {
+            // SEND OUT DATA, the changes of all channels serialized once for all clients.
+            auto frame = std::make_shared<std::vector<uint8_t>>();
+            std::vector<uint8_t> coverage;
 
-            // Connection got accepted, below runs:
-            if (connfd >= 0)
+            // Due signals that did not change since they were last sent are left out.
+            if (!mask.empty() && update(mask, *frame, coverage))
             {
-                status = true; // Connected to the client.
-
-                bzero(_buffer, sizeof(_buffer)); // Setting the buffer to 0
-
-                // While we are connected to the cllient:
-                while (false == server_window_closed)
-                {
-                    // Sleep for interval from settings.
-                    std::this_thread::sleep_for(std::chrono::milliseconds(Setting::INTERVAL));
-
-                    {
-                        std::scoped_lock lock{mtx};
-                        memcpy(_buffer, COMService::buffer, sizeof(_buffer));
-                    }
-
-                    // SEND OUT DATA.
-                    ssize_t bytes_written{-1};
-                    bytes_written = write(connfd, _buffer, BUFLEN);
-
-                    if (BUFLEN != bytes_written)
-                    {
-                        std::cout << "Server lost connection to the client" << std::endl;
-                        shutdown(sockfd, SHUT_RDWR);
-                        shutdown(connfd, SHUT_RDWR);
-                        
-                        close(connfd);
-                        close(sockfd);
-                        break;
-                    }
-                    else
-                    {
-                        ;
-                    }
-                }
-            }
-            else
-            {
-                ;
+                auto signals = std::make_shared<const std::vector<uint8_t>>(std::move(coverage));
+                broadcaster.broadcast(frame, signals, keyframe);
+                websocket.broadcast(frame, signals, keyframe);
+                any = true;
             }
         }
-        else
+
+        if (any)
         {
-            ;
+            send_clock.sent();
         }
+        send_clock.arm(wheel.deadline());
+
+        // Clients that sent control messages and then went silent are gone without a FIN.
+        broadcaster.expire(Protocol::now(), Setting::CONTROL::KEEPALIVE_TIMEOUT * MILLISECOND);
+        websocket.expire(Protocol::now(), Setting::CONTROL::KEEPALIVE_TIMEOUT * MILLISECOND);
+
+        clients = broadcaster.size() + websocket.size();
+        status = (clients > 0); // Connected to at least one client.
     }
-    // Close the socket when the server window is closed
-    if (sockfd >= 0) {
-        shutdown(sockfd, SHUT_RDWR);
-        close(sockfd);
-    }
-    if (connfd >= 0) {
-        shutdown(connfd, SHUT_RDWR);
-        close(connfd);
-    }
+
+    close(epfd);
     status = false; // Update the status
-}
\ No newline at end of file
+}
@@ -0,0 +1,133 @@
+#include "setting.h"
+#include "uartservice.h"
+#include "usbserial.h"
+#include "serialport.h"
+#include "bridge.h"
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+// UARTService on termios2 instead of QSerialPort, selected with -DUART_BACKEND=TERMIOS.
+// One epoll loop waits for the send clock and hotplug events, writes never block.
+
+// Whether the port was unplugged, takes the pending hotplug events without waiting.
+static bool unplugged(Hotplug &hotplug, const std::string &portName)
+{
+    Hotplug::Event event;
+    bool removed{false};
+
+    while (hotplug.wait(0, event))
+    {
+        removed |= (event.action == Hotplug::Action::REMOVE && event.device == portName);
+    }
+    return removed;
+}
+
+void UARTService::run(void)
+{
+    SerialPort serial;
+    std::string server_ESP_serial_number;
+    std::string portName;
+
+    uint8_t localBuffer[BUFLEN]; // Used to transmit the buffer values, minimising lock time on real buffer.
+    uint8_t frame[FRAMING_ENCODED_LEN(BUFLEN)];
+    uint64_t stalled{0}; // When the driver stopped taking frames, 0 while it takes them
+
+    int epfd{epoll_create1(EPOLL_CLOEXEC)};
+    for (int fd : {send_clock.descriptor(), hotplug.descriptor()})
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    prioritize();
+
+    while (!end)
+    {
+        if (!serial.isOpen())
+        {
+            // By the ESP32's USB serial number, it may come back as another tty after a replug.
+            portName = UsbSerial::locate(SERVER_PORT, server_ESP_serial_number);
+            if (portName.empty() || !serial.open(portName, BAUDRATE, O_WRONLY))
+            {
+                // Until a tty is added, or a retry if it is there but not usable yet, e.g. udev is still setting the permissions.
+                Hotplug::Event event;
+                hotplug.wait(portName.empty() ? Setting::UART::RESCAN_INTERVAL : Setting::UART::RETRY_INTERVAL, event);
+                continue;
+            }
+
+            // Before the first frame, so the ESP32 conflates or queues it as configured. The driver is empty, it takes the few bytes.
+            if (Setting::UART::NOTIFY_MODE >= 0)
+            {
+                uint8_t control[FRAMING_ENCODED_LEN(BRIDGE_CONTROL_LEN)];
+                serial.write(control, bridge_control_mode(Setting::UART::NOTIFY_MODE, control));
+            }
+
+            status = true;
+            stalled = 0;
+            send_clock.arm(Protocol::now());
+        }
+
+        epoll_event events[2];
+        int count{epoll_wait(epfd, events, 2, -1)};
+
+        for (int i = 0; i < count && serial.isOpen(); i++)
+        {
+            if (events[i].data.fd == hotplug.descriptor())
+            {
+                // Reconnect as soon as the kernel reports the ESP32 gone, not when a write fails.
+                if (unplugged(hotplug, portName))
+                {
+                    status = false;
+                    serial.close();
+                }
+                continue;
+            }
+
+            if (!send_clock.expired())
+            {
+                continue;
+            }
+
+            {
+                std::scoped_lock lock(mtx);
+                std::memcpy(localBuffer, channels[0].buffer, BUFLEN); // Buffer will only need to be locked during this copy operation instead of the entire transmission time
+            }
+
+            // A frame the driver has no room for is left out, the next one carries the newest values anyway.
+            size_t length{framing_encode(localBuffer, BUFLEN, frame)};
+            ssize_t written{serial.write(frame, length)};
+            uint64_t now{Protocol::now()};
+
+            if (written > 0)
+            {
+                stalled = 0;
+            }
+            else if (stalled == 0)
+            {
+                stalled = now;
+            }
+            else
+            {
+                ;
+            }
+
+            if (written < 0 || (stalled != 0 && now - stalled >= Setting::UART::LIVENESS_TIMEOUT * 1000000ull))
+            {
+                status = false;
+                serial.close();
+                break;
+            }
+
+            // Absolute deadlines, the time spent writing does not add to the period.
+            send_clock.sent();
+            send_clock.advance(Setting::INTERVAL * 1000000ull);
+        }
+    }
+
+    close(epfd);
+}
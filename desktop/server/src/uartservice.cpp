@@ -1,69 +1,37 @@
 #include <QDebug>
 #include "setting.h"
+#include <QTimer>
 #include <QSerialPort>
-#include <QSerialPortInfo>
+#include <QSocketNotifier>
 #include "uartservice.h"
 #include <iostream>
-#include <QProcess>
+#include <algorithm>
+#include "usbserial.h"
+#include "bridge.h"
 
 // Find Relevant ID number via lsusb
 #define ESP32_PID 0xea60 // Product ID for ESP-C6
 
-// Retrieve the short serial number of a USB device associated with a given TTY port
-QString readSerialFromSys(const QString &portName)
+// Whether the port was unplugged, takes the pending hotplug events without waiting.
+static bool unplugged(Hotplug &hotplug, const std::string &portName)
 {
-    QString serialNumber{};
+    Hotplug::Event event;
+    bool removed{false};
 
-    QProcess process;
-    process.start("udevadm", QStringList() << "info" << "-q" << "all" << "-n" << portName);
-
-    if (!process.waitForFinished(1000)) // wait up to 1 second
-    {
-        ;
-    }
-
-    else
+    while (hotplug.wait(0, event))
     {
-        QString output = process.readAllStandardOutput();
-
-        // Extract the ID_SERIAL_SHORT line
-        for (const QString &line : output.split('\n'))
-        {
-            if (line.startsWith("E: ID_SERIAL_SHORT="))
-            {
-                serialNumber = line.section('=', 1);
-                break; // stop as soon as we find it
-            }
-        }
+        removed |= (event.action == Hotplug::Action::REMOVE && event.device == portName);
     }
-
-    return serialNumber;
-}
-
-QString findAvailablePort(const QString &espSN)
-{
-    QString port;
-
-    foreach (const QSerialPortInfo &info, QSerialPortInfo::availablePorts())
-    {
-        QString sysSN = readSerialFromSys(info.systemLocation());
-
-        if (sysSN == espSN) // SN match is enough
-        {
-            port = info.systemLocation();
-            break;
-        }
-    }
-    return port;
+    return removed;
 }
 
 void UARTService::run(void)
 {
     QSerialPort serial;
-    QString server_ESP_serial_number{};
+    std::string server_ESP_serial_number;
+    std::string portName; // As located, /dev/ttyXXX like the hotplug events, QSerialPort::portName() drops the /dev/
 
-    QString portName{SERVER_PORT};
-    serial.setPortName(portName);
+    serial.setPortName(SERVER_PORT);
     serial.setBaudRate(BAUDRATE);
     serial.setDataBits(QSerialPort::Data8);
     serial.setParity(QSerialPort::NoParity);
@@ -71,88 +39,147 @@ void UARTService::run(void)
     serial.setFlowControl(QSerialPort::NoFlowControl);
 
     uint8_t localBuffer[BUFLEN]; // Used to transmit the buffer values, minimising lock time on real buffer.
+    uint8_t frame[FRAMING_ENCODED_LEN(BUFLEN)];
+    qint64 pending{0}; // Bytes written but not yet handed to the driver
+
+    // Everything below runs on this thread's event loop, nothing blocks on the port.
+    QSocketNotifier tick{send_clock.descriptor(), QSocketNotifier::Read};
+    QSocketNotifier plug{hotplug.descriptor(), QSocketNotifier::Read};
+    QTimer rescan;   // Looks for the ESP32 again in case a hotplug event was missed
+    QTimer liveness; // Runs while bytes are pending, expires if the driver stops taking them
+    rescan.setSingleShot(true);
+    liveness.setSingleShot(true);
+    tick.setEnabled(false);
+
+    auto closePort = [&]()
+    {
+        status = false;
+        serial.close();
+        pending = 0;
+        tick.setEnabled(false);
+        liveness.stop();
+        rescan.start(Setting::UART::RESCAN_INTERVAL);
+    };
+
+    auto openPort = [&]()
+    {
+        if (serial.isOpen())
+        {
+            return;
+        }
 
-    bool SN_messageDisplayed{false};
-    bool wasConnected{false}; // Track previous state
-    bool portErrorDisplayed{false};
+        // By the ESP32's USB serial number, it may come back as another tty after a replug.
+        portName = UsbSerial::locate(SERVER_PORT, server_ESP_serial_number);
+        if (portName.empty())
+        {
+            rescan.start(Setting::UART::RESCAN_INTERVAL);
+            return;
+        }
 
-    while (!end)
-    {
-        if (server_ESP_serial_number.isEmpty())
+        serial.setPortName(QString::fromStdString(portName));
+        if (!serial.open(QIODevice::WriteOnly))
         {
-            if (!SN_messageDisplayed)
-            {
-                SN_messageDisplayed = true;
-            }
+            // Plugged in but not usable yet, e.g. udev is still setting the permissions.
+            rescan.start(Setting::UART::RETRY_INTERVAL);
+            return;
+        }
 
-            server_ESP_serial_number = readSerialFromSys(SERVER_PORT);
+        // Before the first frame, so the ESP32 conflates or queues it as configured.
+        if (Setting::UART::NOTIFY_MODE >= 0)
+        {
+            uint8_t control[FRAMING_ENCODED_LEN(BRIDGE_CONTROL_LEN)];
+            size_t length{bridge_control_mode(Setting::UART::NOTIFY_MODE, control)};
+            pending += std::max<qint64>(serial.write(reinterpret_cast<char *>(control), length), 0);
         }
 
-        else
+        status = true;
+        send_clock.arm(Protocol::now());
+        tick.setEnabled(true);
+    };
+
+    QObject::connect(&tick, &QSocketNotifier::activated, &serial, [&]()
+                     {
+        if (!send_clock.expired())
         {
-            break;
+            return;
         }
-        msleep(500);
-    }
 
-    while (!end)
-    {
-        // Ensure port is open
-        if (!serial.isOpen())
         {
-            if (!serial.open(QIODevice::WriteOnly))
-            {
-                if (wasConnected) // Only log once when losing connection
-                {
-                    wasConnected = false;
-                }
-                msleep(500); // Retry every 0.5s
-
-                portName = findAvailablePort(server_ESP_serial_number);
-                if (portName.isEmpty())
-                {
-
-                    if (!portErrorDisplayed)
-                    {
-                        portErrorDisplayed = true;
-                    }
-
-                    continue;
-                }
-
-                else
-                {
-                    serial.setPortName(portName);
-                    portErrorDisplayed = false;
-                }
-            }
-
-            continue;
+            std::scoped_lock lock(mtx);
+            std::memcpy(localBuffer, channels[0].buffer, BUFLEN); // Buffer will only need to be locked during this copy operation instead of the entire transmission time
         }
-        else
+
+        // COBS with a CRC, the ESP32 drops a damaged frame and resyncs on the next one.
+        size_t length{framing_encode(localBuffer, BUFLEN, frame)};
+        qint64 written{serial.write(reinterpret_cast<char *>(frame), length)};
+        if (written < 0)
+        {
+            closePort();
+            return;
+        }
+        pending += written;
+
+        if (!liveness.isActive())
+        {
+            liveness.start(Setting::UART::LIVENESS_TIMEOUT);
+        }
+
+        // Absolute deadlines, the time spent writing does not add to the period.
+        send_clock.sent();
+        send_clock.advance(Setting::INTERVAL * 1000000ull); });
+
+    QObject::connect(&serial, &QSerialPort::bytesWritten, &serial, [&](qint64 bytes)
+                     {
+        pending = std::max<qint64>(pending - bytes, 0);
+
+        // Progress, the timer only runs out if the driver takes nothing for a whole timeout.
+        if (pending > 0)
         {
-            status = true;
-            wasConnected = true;
+            liveness.start(Setting::UART::LIVENESS_TIMEOUT);
         }
+        else
+        {
+            liveness.stop();
+        } });
 
-        while (!end)
+    QObject::connect(&serial, &QSerialPort::errorOccurred, &serial, [&](QSerialPort::SerialPortError error)
+                     {
+        if (error == QSerialPort::ResourceError && serial.isOpen())
         {
-            {
-                std::scoped_lock lock(mtx);
-                std::memcpy(localBuffer, buffer, BUFLEN); // Buffer will only need to be locked during this copy operation instead of the entire transmission time
-            }
+            closePort();
+        } });
 
-            serial.write(reinterpret_cast<char *>(localBuffer), BUFLEN);
+    QObject::connect(&liveness, &QTimer::timeout, &serial, closePort);
+    QObject::connect(&rescan, &QTimer::timeout, &serial, openPort);
 
-            if (!serial.waitForBytesWritten(100)) // Timeout in ms
-            {
-                status = false;
-                serial.close();
-                break;
-            }
+    QObject::connect(&plug, &QSocketNotifier::activated, &serial, [&]()
+                     {
+        // Reconnect as soon as the kernel reports the ESP32 gone, and look for it when a tty is added.
+        bool removed{unplugged(hotplug, portName)};
 
-            msleep(Setting::INTERVAL);
+        if (end)
+        {
+            exit();
+        }
+        else if (removed && serial.isOpen())
+        {
+            closePort();
+        }
+        else if (!serial.isOpen())
+        {
+            openPort();
         }
+        else
+        {
+            ;
+        } });
+
+    prioritize();
+    openPort();
+
+    if (!end)
+    {
+        exec(); // Until the destructor's hotplug.wake()
     }
     serial.close();
-}
\ No newline at end of file
+}
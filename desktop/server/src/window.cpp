@@ -121,6 +121,8 @@ Window::Window(COMService &com_service)
     gridLayout.addLayout(&CheckLayout, 3, 1);
 
     mainLayout.addLayout(&gridLayout);
+    mainLayout.addWidget(&labelStatus);
+    mainLayout.addWidget(&labelJitter);
     mainLayout.setSizeConstraint(QLayout::SetFixedSize);
     setWindowFlags(windowFlags() | Qt::WindowStaysOnTopHint | Qt::Dialog);
     setModal(true); // Makes the dialog modal, so clicking outside won’t close it
@@ -160,5 +162,33 @@ Window::Window(COMService &com_service)
         com_service.setRightLight(checkbox2.isChecked());
     } });
 
+    // Clients and the latency they report back with their acks
+    connect(&status_timer, &QTimer::timeout, this, [this, &com_service]()
+            { labelStatus.setText(QString("Clients: %1    Render latency p50 %2 ms, p99 %3 ms")
+                                      .arg(com_service.getClients())
+                                      .arg(com_service.getClientLatency(50) / 1000.0, 0, 'f', 1)
+                                      .arg(com_service.getClientLatency(99) / 1000.0, 0, 'f', 1));
+
+                // How late frames went out compared to their schedule, bucket by bucket
+                const Histogram &jitter{com_service.getJitter()};
+                QString text{QString("Worst queue delay urgent %1 us, normal %2 us, bulk %3 us\n")
+                                 .arg(com_service.getWorstDelay(Setting::URGENT))
+                                 .arg(com_service.getWorstDelay(Setting::NORMAL))
+                                 .arg(com_service.getWorstDelay(Setting::BULK))};
+                text += QString("Send jitter p50 %1 us, p99 %2 us, max %3 us\n")
+                            .arg(jitter.percentile(50))
+                            .arg(jitter.percentile(99))
+                            .arg(jitter.max());
+                for (size_t bucket = 0; bucket <= Histogram::BUCKETS; bucket++)
+                {
+                    if (jitter.count(bucket) > 0)
+                    {
+                        text += (bucket < Histogram::BUCKETS) ? QString("<%1: %2   ").arg(Histogram::bound(bucket)).arg(jitter.count(bucket))
+                                                              : QString("more: %1").arg(jitter.count(bucket));
+                    }
+                }
+                labelJitter.setText(text); });
+    status_timer.start(500);
+
     setWindowTitle("Server");
 }
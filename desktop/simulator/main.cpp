@@ -0,0 +1,301 @@
+#include <deque>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include "setting.h"
+#include "framing.h"
+#include "protocol.h"
+
+// Stand-in for the server ESP32, the BLE link and the client ESP32: frames the desktop server writes
+// to one PTY come out of another PTY for the desktop client, late, out of a bounded queue, and as
+// lossy as asked for. Both PTYs are symlinked to SERVER_PORT and CLIENT_PORT of a UART_SIMULATOR build.
+
+constexpr uint64_t MILLISECOND{1000000};
+
+static std::atomic<bool> stop{false};
+
+static void on_signal(int)
+{
+    stop = true;
+}
+
+struct Options
+{
+    int delay{Setting::SIMULATOR::DELAY};   // ms
+    int jitter{Setting::SIMULATOR::JITTER}; // ms
+    double loss{0};                         // Probability of losing a byte on the client's UART
+    int rate{0};                            // Bytes per second to the client, 0 = unlimited
+    int queue{Setting::SIMULATOR::QUEUE};
+    std::string server{SERVER_PORT};
+    std::string client{CLIENT_PORT};
+};
+
+struct Pty
+{
+    int master{-1};
+    int slave{-1}; // Kept open so the master sees no hangup while the desktop side reconnects
+    std::string link;
+};
+
+struct Pending
+{
+    uint64_t due;
+    uint8_t payload[BUFLEN];
+};
+
+struct Counters
+{
+    uint64_t received{0};  // Valid frames from the server
+    uint64_t damaged{0};   // Frames from the server that failed the CRC
+    uint64_t dropped{0};   // Frames that found the queue full
+    uint64_t delivered{0}; // Frames written to the client
+    uint64_t lost{0};      // Bytes lost on purpose
+    uint64_t unread{0};    // Bytes the client PTY had no room for, nobody is reading it
+};
+
+// A PTY pair in raw mode, its slave reachable through a symlink at link.
+static bool open_pty(const std::string &link, Pty &pty)
+{
+    struct stat info{};
+    if (0 == lstat(link.c_str(), &info) && !S_ISLNK(info.st_mode))
+    {
+        std::fprintf(stderr, "uartsim: %s exists and is no symlink\n", link.c_str());
+        return false;
+    }
+
+    pty.master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (pty.master < 0 || 0 != grantpt(pty.master) || 0 != unlockpt(pty.master))
+    {
+        return false;
+    }
+
+    std::string slave{ptsname(pty.master)};
+    pty.slave = open(slave.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+
+    // No echo and no newline translation, the frames are binary.
+    termios tio{};
+    if (pty.slave < 0 || 0 != tcgetattr(pty.slave, &tio))
+    {
+        return false;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(pty.slave, TCSANOW, &tio);
+
+    unlink(link.c_str());
+    if (0 != symlink(slave.c_str(), link.c_str()))
+    {
+        std::fprintf(stderr, "uartsim: cannot link %s: %s\n", link.c_str(), strerror(errno));
+        return false;
+    }
+
+    pty.link = link;
+    std::printf("uartsim: %s -> %s\n", link.c_str(), slave.c_str());
+    return true;
+}
+
+static void close_pty(Pty &pty)
+{
+    if (!pty.link.empty())
+    {
+        unlink(pty.link.c_str());
+    }
+
+    for (int fd : {pty.master, pty.slave})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+}
+
+static void usage(const char *name)
+{
+    std::printf("Usage: %s [--delay MS] [--jitter MS] [--loss P] [--rate BYTES] [--queue FRAMES] [--server PATH] [--client PATH]\n"
+                "  --delay   Latency of the link (default %d ms)\n"
+                "  --jitter  Random extra latency, frames stay in order (default %d ms)\n"
+                "  --loss    Probability of losing each byte on the client's UART (default 0)\n"
+                "  --rate    Throughput cap in bytes per second, 0 for none (default 0)\n"
+                "  --queue   Frames held while the link is behind (default %d)\n"
+                "  --server  PTY the server writes to (default %s)\n"
+                "  --client  PTY the client reads from (default %s)\n",
+                name, Setting::SIMULATOR::DELAY, Setting::SIMULATOR::JITTER, Setting::SIMULATOR::QUEUE, SERVER_PORT, CLIENT_PORT);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--delay") && i + 1 < argc)
+        {
+            options.delay = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "--jitter") && i + 1 < argc)
+        {
+            options.jitter = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "--loss") && i + 1 < argc)
+        {
+            options.loss = std::clamp(std::atof(argv[++i]), 0.0, 1.0);
+        }
+        else if (0 == strcmp(argv[i], "--rate") && i + 1 < argc)
+        {
+            options.rate = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "--queue") && i + 1 < argc)
+        {
+            options.queue = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "--server") && i + 1 < argc)
+        {
+            options.server = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "--client") && i + 1 < argc)
+        {
+            options.client = argv[++i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Pty server, client;
+    if (!open_pty(options.server, server) || !open_pty(options.client, client))
+    {
+        close_pty(server);
+        close_pty(client);
+        return EXIT_FAILURE;
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::mt19937 random{std::random_device{}()};
+    std::uniform_int_distribution<uint64_t> jitter{0, static_cast<uint64_t>(options.jitter) * MILLISECOND};
+    std::bernoulli_distribution lose{options.loss};
+
+    std::deque<Pending> queue;
+    framing_decoder_t decoder{};
+    Counters counters;
+    uint64_t last_due{0};  // Frames leave in order, none before the one ahead of it
+    uint64_t link_free{0}; // When the capped link has sent the previous frame
+    uint64_t next_report{Protocol::now() + Setting::SIMULATOR::REPORT_INTERVAL * MILLISECOND};
+
+    while (!stop)
+    {
+        uint64_t now{Protocol::now()};
+
+        // Frames that are due, as fast as the throughput cap lets them go.
+        while (!queue.empty() && queue.front().due <= now && link_free <= now)
+        {
+            uint8_t frame[FRAMING_ENCODED_LEN(BUFLEN)];
+            uint8_t out[sizeof(frame)];
+            size_t length{framing_encode(queue.front().payload, BUFLEN, frame)};
+            size_t kept{0};
+
+            for (size_t i = 0; i < length; i++)
+            {
+                if (options.loss > 0 && lose(random))
+                {
+                    counters.lost++;
+                }
+                else
+                {
+                    out[kept++] = frame[i];
+                }
+            }
+
+            ssize_t written{write(client.master, out, kept)};
+            counters.unread += kept - static_cast<size_t>(std::max<ssize_t>(written, 0));
+            counters.delivered++;
+            queue.pop_front();
+
+            if (options.rate > 0)
+            {
+                link_free = now + length * 1000000000ull / options.rate;
+            }
+        }
+
+        if (now >= next_report)
+        {
+            std::printf("uartsim: %llu frames in, %llu damaged, %llu dropped, %llu out, %llu bytes lost, %llu bytes unread, %zu queued\n",
+                        static_cast<unsigned long long>(counters.received), static_cast<unsigned long long>(counters.damaged),
+                        static_cast<unsigned long long>(counters.dropped), static_cast<unsigned long long>(counters.delivered),
+                        static_cast<unsigned long long>(counters.lost), static_cast<unsigned long long>(counters.unread), queue.size());
+            std::fflush(stdout);
+            next_report = now + Setting::SIMULATOR::REPORT_INTERVAL * MILLISECOND;
+        }
+
+        // Sleep until the server writes, the next frame is due, or the next report.
+        uint64_t wake{next_report};
+        if (!queue.empty())
+        {
+            wake = std::min(wake, std::max(queue.front().due, link_free));
+        }
+
+        uint64_t wait{wake > now ? wake - now : 0};
+        timespec timeout{static_cast<time_t>(wait / 1000000000), static_cast<long>(wait % 1000000000)};
+        pollfd pfd{server.master, POLLIN, 0};
+
+        if (ppoll(&pfd, 1, &timeout, nullptr) <= 0)
+        {
+            continue;
+        }
+
+        uint8_t buffer[4096];
+        ssize_t length;
+        while ((length = read(server.master, buffer, sizeof(buffer))) > 0)
+        {
+            uint64_t received{Protocol::now()};
+
+            // The server ESP32 drops damaged frames and queues the rest for the link.
+            for (ssize_t i = 0; i < length; i++)
+            {
+                int size{framing_feed(&decoder, buffer[i])};
+
+                if (size < 0)
+                {
+                    counters.damaged++;
+                }
+                else if (size != BUFLEN)
+                {
+                    continue;
+                }
+                else if (queue.size() >= static_cast<size_t>(options.queue))
+                {
+                    counters.received++;
+                    counters.dropped++;
+                }
+                else
+                {
+                    counters.received++;
+                    last_due = std::max(last_due, received + options.delay * MILLISECOND + jitter(random));
+
+                    Pending pending{last_due, {}};
+                    memcpy(pending.payload, decoder.data, BUFLEN);
+                    queue.push_back(pending);
+                }
+            }
+        }
+    }
+
+    close_pty(server);
+    close_pty(client);
+    return EXIT_SUCCESS;
+}
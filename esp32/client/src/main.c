@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include "setting.h"
+#include "bridge.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "driver/uart.h"
@@ -19,7 +20,8 @@
 
 #define UART_NUM UART_NUM_0              // Using UART0
 #define BUF_SIZE (3 * SOC_UART_FIFO_LEN) // Buffer size shall be greater than SOC_UART_FIFO_LEN
-#define MSGLEN 3                         // Message length
+#define MSGLEN BRIDGE_FRAME_LEN          // Message length
+#define TX_BUF_SIZE (BUF_SIZE + BRIDGE_UNPACKED_MAX) // A whole unpacked notification fits while the last one still drains
 #define SERVER_BAUDRATE 1048576
 
 static int client_gap_event(struct ble_gap_event *event, void *arg);
@@ -195,6 +197,14 @@ static int client_gap_event(struct ble_gap_event *event, void *)
             connection = event->connect.conn_handle;
             memcpy(peer_addr.val, desc.peer_id_addr.val, sizeof(desc.peer_id_addr.val));
 
+            /* A larger MTU lets the server pack more frames into each notification. */
+            status = ble_gattc_exchange_mtu(event->connect.conn_handle, NULL, NULL);
+            if (status != 0)
+            {
+                ESP_LOGE(TAG, "Failed to exchange MTU; status=%d\n", status);
+                status = 0;
+            }
+
             assert(0 == ble_gattc_disc_svc_by_uuid(event->connect.conn_handle, BLE_UUID16_DECLARE(GATT_SVC_UUID), on_service_discovery, NULL));
         }
         else
@@ -236,7 +246,11 @@ static int client_gap_event(struct ble_gap_event *event, void *)
         // Attribute data is in event->notify_rx.om.
         assert(0 == os_mbuf_copydata(event->notify_rx.om, 0, sizeof(buffer), buffer));
 
-        if (MSGLEN != uart_write_bytes(UART_NUM, buffer, MSGLEN))
+        // Every frame packed into the notification, in order.
+        uint8_t frames[BRIDGE_UNPACKED_MAX];
+        int length = (int)bridge_client_rx((const uint8_t *)buffer, sizeof(buffer), frames, sizeof(frames));
+
+        if (length > 0 && length != uart_write_bytes(UART_NUM, frames, length))
         {
             ESP_LOGE(TAG, "Failed to write");
         }
@@ -301,6 +315,9 @@ void app_main(void)
     /* Set the default device name. */
     assert(0 == ble_svc_gap_device_name_set(DEVICE_NAME));
 
+    /* Asked for in the MTU exchange after connecting. */
+    assert(0 == ble_att_set_preferred_mtu(BRIDGE_ATT_MTU));
+
     uart_config_t config = {
         .baud_rate = SERVER_BAUDRATE,
         .data_bits = UART_DATA_8_BITS,
@@ -310,8 +327,8 @@ void app_main(void)
         .source_clk = UART_SCLK_DEFAULT,
     };
 
-    // Install driver and configure UART
-    ESP_ERROR_CHECK(uart_driver_install(UART_NUM, BUF_SIZE, 0, 0, NULL, 0));
+    // Install driver and configure UART, with a TX buffer so writing a notification's frames does not block the host task.
+    ESP_ERROR_CHECK(uart_driver_install(UART_NUM, BUF_SIZE, TX_BUF_SIZE, 0, NULL, 0));
     ESP_ERROR_CHECK(uart_param_config(UART_NUM, &config));
     ESP_ERROR_CHECK(uart_set_pin(UART_NUM, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
 
@@ -1,6 +1,8 @@
 #include "esp_bt.h"
 // #include "setting.h"
+#include "bridge.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <stdbool.h>
 #include "nvs_flash.h"
 #include "nimble/ble.h"
@@ -21,17 +23,13 @@
 #define DEVICE_NAME "BLE_SERVER"
 #define UART_NUM UART_NUM_0              // Using UART0
 #define BUF_SIZE (3 * SOC_UART_FIFO_LEN) // Buffer size shall be greater than SOC_UART_FIFO_LEN
-#define MSGLEN 3                         // Message length
+#define MSGLEN BRIDGE_FRAME_LEN          // Message length
 #define SERVER_BAUDRATE 1048576
+#define UART_EVENTS 20    // Driver events waiting for the UART task
+#define UART_RX_TIMEOUT 2 // Byte times of silence before the driver reports what it received
 
 #define BLE_SVC_UUID16 0xABC0     /* 16 Bit Service UUID */
 #define BLE_SVC_CHR_UUID16 0xABC1 /* 16 Bit Service Characteristic UUID */
-#define UART_QUEUE_LEN 64         // max messages queued
-
-typedef struct
-{
-    uint8_t data[MSGLEN];
-} uart_msg_t;
 
 #if 1 // S3 specific on-board LED Strip.
 // My onboard_led_strip:
@@ -99,17 +97,19 @@ static void on_board_led_strip(enum on_board_led_strip led)
 }
 #endif
 
-// Circular buffer
-static uart_msg_t uart_queue[UART_QUEUE_LEN];
-static volatile int uart_head = 0; // index to write
-static volatile int uart_tail = 0; // index to read
+// Frames from the UART queued for the notifications, urgent frames in a ring of their own that is notified first. See shared/bridge.h,
+// build with -DBRIDGE_DROP_POLICY=BRIDGE_DROP_OLDEST for a full queue to keep the newest frames, and with
+// -DBRIDGE_MODE=BRIDGE_MODE_LATEST to notify only the newest frame. The desktop server may switch the mode.
+static bridge_server_t bridge;
+static TaskHandle_t notify_handle = NULL; // Woken by the UART task and the subscribe event
+static QueueHandle_t uart_queue = NULL;   // Events of the UART driver
 
 static int server_gap_event(struct ble_gap_event *event, void *arg);
 static int service_gatt_handler(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
 
 static uint8_t own_addr_type;
 static uint16_t ble_svc_gatt_read_val_handle;
-static uint16_t server_conn_handle = 0;
+static uint16_t server_conn_handle = BLE_HS_CONN_HANDLE_NONE; // Set once a client subscribed to the notifications
 
 // For random static address, 2 MSB bits of the first byte shall be 0b11.
 // I.e. addr[5] shall be in the range of 0xC0 to 0xFF
@@ -269,6 +269,12 @@ static int server_gap_event(struct ble_gap_event *event, void *)
         {
             server_conn_handle = event->subscribe.conn_handle;
             ESP_LOGI(TAG, "Client subscribed, notifications enabled");
+
+            // Frames queued before the subscription go out now.
+            if (notify_handle != NULL)
+            {
+                xTaskNotifyGive(notify_handle);
+            }
         }
         else
         {
@@ -371,30 +377,84 @@ int gatt_svr_init(void)
     return rc;
 }
 
+// Queue the frames in bytes received on the UART and wake the notify task for them.
+static void uart_receive(const uint8_t *bytes, int length)
+{
+    uint32_t damaged = bridge.decoder.bad;
+    uint32_t dropped = bridge_dropped(&bridge);
+    int mode = bridge.mode;
+
+    if (bridge_uart_rx(&bridge, bytes, length, esp_timer_get_time()) > 0)
+    {
+        // Without a subscriber the frames wait, the subscribe event wakes the notify task for them.
+        if (server_conn_handle != BLE_HS_CONN_HANDLE_NONE)
+        {
+            xTaskNotifyGive(notify_handle);
+        }
+        on_board_led_strip(LED_RED);
+    }
+
+    if (bridge.decoder.bad != damaged)
+    {
+        ESP_LOGW(TAG, "UART frame damaged, dropped (%lu so far)", (unsigned long)bridge.decoder.bad);
+    }
+    if (bridge_dropped(&bridge) != dropped)
+    {
+        ESP_LOGW(TAG, "UART queue full, dropped %lu %s messages so far", (unsigned long)bridge_dropped(&bridge),
+                 (bridge.normal.policy == BRIDGE_DROP_OLDEST) ? "oldest" : "newest");
+    }
+    if (bridge.mode != mode)
+    {
+        ESP_LOGI(TAG, "Bridge mode %s", (bridge.mode == BRIDGE_MODE_LATEST) ? "latest value" : "queued");
+    }
+    on_board_led_strip(LED_BLUE);
+}
+
+// Driven by the UART driver's events. No pattern detection: it needs idle time around the delimiter,
+// which frames written back to back do not have, and the decoder finds the delimiters anyway.
 void uart_task(void *pvParameters)
 {
-    uint8_t buffer[MSGLEN];
+    uart_event_t event;
+    uint8_t chunk[BUF_SIZE];
 
     while (1)
     {
-        // Blocking read from UART
-        int n = uart_read_bytes(UART_NUM, buffer, MSGLEN, portMAX_DELAY);
-        if (n == MSGLEN)
+        if (pdTRUE != xQueueReceive(uart_queue, &event, portMAX_DELAY))
         {
-            on_board_led_strip(LED_RED);
-            int next_head = (uart_head + 1) % UART_QUEUE_LEN;
-            if (next_head != uart_tail) // queue not full
-            {
-                memcpy(uart_queue[uart_head].data, buffer, MSGLEN);
-                uart_head = next_head;
-            }
-            else
+            continue;
+        }
+
+        switch (event.type)
+        {
+        case UART_DATA:
+        {
+            // Everything buffered by now, however many frames that is, not only the event's bytes.
+            size_t pending = 0;
+            while (ESP_OK == uart_get_buffered_data_len(UART_NUM, &pending) && pending > 0)
             {
-                // Queue full, drop message
-                ESP_LOGW(TAG, "UART queue full, dropping message");
+                int n = uart_read_bytes(UART_NUM, chunk, pending < sizeof(chunk) ? pending : sizeof(chunk), 0);
+                if (n <= 0)
+                {
+                    break;
+                }
+                uart_receive(chunk, n);
             }
+            break;
+        }
+
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            // Bytes were lost, start over at the next delimiter with what arrives from now on.
+            ESP_LOGW(TAG, "UART %s, input flushed", (event.type == UART_FIFO_OVF) ? "FIFO overflow" : "buffer full");
+            uart_flush_input(UART_NUM);
+            xQueueReset(uart_queue);
+            bridge_uart_resync(&bridge);
+            break;
+
+        default:
+            // Frame and parity errors damage a byte, the CRC drops its frame.
+            break;
         }
-        on_board_led_strip(LED_BLUE);
     }
 }
 
@@ -402,36 +462,38 @@ void notify_task(void *pvParameters)
 {
     while (1)
     {
-        if (server_conn_handle != BLE_HS_CONN_HANDLE_NONE)
+        // Sleep until the UART task queues a frame or a client subscribes, wakeups given meanwhile are counted.
+        if (server_conn_handle == BLE_HS_CONN_HANDLE_NONE || !bridge_pending(&bridge))
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        else
         {
-            // Check if queue is not empty
-            if (uart_tail != uart_head)
+            // As many queued frames as the negotiated MTU holds in one notification.
+            uint8_t packet[BRIDGE_PACKED_MAX];
+            uint16_t mtu = ble_att_mtu(server_conn_handle);
+            size_t capacity = (mtu > BRIDGE_ATT_MTU_MIN) ? mtu - BRIDGE_ATT_OVERHEAD : BRIDGE_ATT_MTU_MIN - BRIDGE_ATT_OVERHEAD;
+            size_t length = 0;
+            int frames = bridge_pack(&bridge, packet, capacity < sizeof(packet) ? capacity : sizeof(packet), &length);
+
+            if (frames > 0)
             {
-                uint8_t *msg = uart_queue[uart_tail].data;
-                struct os_mbuf *om = ble_hs_mbuf_from_flat(msg, MSGLEN);
-                int rc = ble_gatts_notify_custom(server_conn_handle, ble_svc_gatt_read_val_handle, om);
+                // NimBLE frees om itself, also when the notification fails. The bridge holds the frames until one is taken.
+                struct os_mbuf *om = ble_hs_mbuf_from_flat(packet, length);
+                int rc = (om != NULL) ? ble_gatts_notify_custom(server_conn_handle, ble_svc_gatt_read_val_handle, om) : BLE_HS_ENOMEM;
+
+                if (bridge_notified(&bridge, frames, rc == 0, esp_timer_get_time()))
+                {
+                    ESP_LOGI(TAG, "Urgent frame worst-case queue delay %lld us", (long long)bridge.urgent_worst_us);
+                }
 
                 if (rc != 0)
                 {
-                    ESP_LOGE(TAG, "Notify failed: %d", rc);
-                    os_mbuf_free_chain(om);
+                    ESP_LOGE(TAG, "Notify failed: %d, %d frames held, %lu failed so far", rc, frames, (unsigned long)bridge.failed);
                     vTaskDelay(1); // back off
                 }
-
-                // Advance tail
-                uart_tail = (uart_tail + 1) % UART_QUEUE_LEN;
-            }
-            else
-            {
-                // Queue empty, yield
-                vTaskDelay(1);
             }
         }
-        else
-        {
-            // Not connected, sleep
-            vTaskDelay(5);
-        }
     }
 }
 
@@ -459,6 +521,9 @@ void app_main(void)
     /* Register custom service */
     assert(0 == gatt_svr_init());
 
+    /* Room for many frames per notification once the client exchanged the MTU. */
+    assert(0 == ble_att_set_preferred_mtu(BRIDGE_ATT_MTU));
+
     /* Set the default device name. */
     assert(0 == ble_svc_gap_device_name_set(DEVICE_NAME));
 
@@ -471,23 +536,28 @@ void app_main(void)
         .source_clk = UART_SCLK_DEFAULT,
     };
 
-    // Install driver and configure UART
-    ESP_ERROR_CHECK(uart_driver_install(UART_NUM, BUF_SIZE, 0, 0, NULL, 0));
+    // Install driver and configure UART, it reports received bytes on the event queue.
+    ESP_ERROR_CHECK(uart_driver_install(UART_NUM, BUF_SIZE, 0, UART_EVENTS, &uart_queue, 0));
     ESP_ERROR_CHECK(uart_param_config(UART_NUM, &config));
     ESP_ERROR_CHECK(uart_set_pin(UART_NUM, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    ESP_ERROR_CHECK(uart_set_rx_timeout(UART_NUM, UART_RX_TIMEOUT)); // A lone frame is reported right after its delimiter
 
     ESP_LOGI(TAG, "UART initialized");
 
-    // --- Start UART producer task ---
-    assert(pdTRUE == xTaskCreate(uart_task, "uart_task", 2048, NULL, 3, NULL));
+    bridge_server_init(&bridge, BRIDGE_DROP_POLICY);
+    bridge_set_mode(&bridge, BRIDGE_MODE);
 
+    // The notify task first, the UART task wakes it by its handle.
     assert(pdTRUE == xTaskCreate(
                          notify_task,
                          "notify_task",
                          4096,
                          NULL,
                          2,
-                         NULL));
+                         &notify_handle));
+
+    // --- Start UART producer task ---
+    assert(pdTRUE == xTaskCreate(uart_task, "uart_task", 3072, NULL, 3, NULL));
 
     ESP_LOGI(TAG, "BLE Host Task Started");
 
@@ -0,0 +1,577 @@
+#ifndef BRIDGE_H
+#define BRIDGE_H
+
+// Logic of the ESP32 BLE bridges without ESP-IDF, NimBLE or FreeRTOS (plain C, header only).
+//
+// The server bridge decodes the frames the desktop server writes to its UART and queues them for
+// the BLE notifications, urgent ones first, packed up to the ATT MTU with their seq. The client
+// bridge turns a received notification back into UART frames for the desktop client, which tells
+// the frames an urgent one overtook by their seq, see bridge_overtaken(). The firmware wraps these
+// calls with the UART driver, the NimBLE host and its tasks, bridgebench on the desktop wraps them
+// with a simulated UART and BLE link, so queue behaviour can be measured and tuned without boards.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "setting.h"
+#include "framing.h"
+
+#define BRIDGE_FRAME_LEN BUFLEN // Bytes of a frame, every frame holds all signals
+#define BRIDGE_QUEUE_LEN 64     // Frames queued per priority, a power of two
+
+// Which frame a full ring gives up, see bridge_ring_t.
+#define BRIDGE_DROP_NEWEST 0 // The one arriving, the queue keeps the oldest frames (lossless prefix, e.g. logging)
+#define BRIDGE_DROP_OLDEST 1 // The oldest queued one, the queue keeps the newest frames (gauges)
+
+#ifndef BRIDGE_DROP_POLICY
+#define BRIDGE_DROP_POLICY BRIDGE_DROP_NEWEST
+#endif
+
+// What the notifications carry, see bridge_next().
+#define BRIDGE_MODE_QUEUED 0 // Every queued frame, urgent ones first, the seq restores the order (lossless logging)
+#define BRIDGE_MODE_LATEST 1 // Only the newest frame, the ones it supersedes are dropped (gauges)
+
+#ifndef BRIDGE_MODE
+#define BRIDGE_MODE BRIDGE_MODE_QUEUED
+#endif
+
+// A notification carries as many frames as the ATT MTU allows, each as [length][frame bytes][seq].
+#define BRIDGE_ATT_OVERHEAD 3  // Opcode and attribute handle of a notification
+#define BRIDGE_ATT_MTU_MIN 23  // Every connection supports it, before the MTU exchange
+#define BRIDGE_ATT_MTU 247     // Asked for in the MTU exchange, one LE data packet with data length extension
+#define BRIDGE_SEQ_LEN 2       // Low bytes of the seq, little endian
+#define BRIDGE_TAGGED_LEN (BRIDGE_FRAME_LEN + BRIDGE_SEQ_LEN) // A frame and its seq, as the client bridge forwards it
+#define BRIDGE_RECORD_LEN (1 + BRIDGE_TAGGED_LEN)
+#define BRIDGE_PACKED_MAX (BRIDGE_ATT_MTU - BRIDGE_ATT_OVERHEAD) // Largest notification value
+#define BRIDGE_UNPACKED_MAX (BRIDGE_PACKED_MAX / BRIDGE_RECORD_LEN * FRAMING_ENCODED_LEN(BRIDGE_TAGGED_LEN))
+
+// Control frames from the desktop server on the same UART, told apart from data frames by their length.
+#define BRIDGE_CONTROL_LEN 2
+#define BRIDGE_CONTROL_MODE 0x01 // {BRIDGE_CONTROL_MODE, BRIDGE_MODE_...}
+
+#if BRIDGE_CONTROL_LEN == BRIDGE_FRAME_LEN || BRIDGE_CONTROL_LEN == BRIDGE_TAGGED_LEN
+#error "Control frames must differ in length from data frames"
+#endif
+
+#if BRIDGE_TAGGED_LEN > FRAMING_MAX_PAYLOAD
+#error "FRAMING_MAX_PAYLOAD must hold a frame and its seq"
+#endif
+
+#if (BRIDGE_QUEUE_LEN & (BRIDGE_QUEUE_LEN - 1)) != 0
+#error "BRIDGE_QUEUE_LEN must be a power of two"
+#endif
+
+// Bits of the URGENT signals in SIGNAL_LIST (signal-left, signal-right), a frame that changes them goes to the urgent ring.
+// The ESP32 cannot read SIGNAL_LIST, bridgebench fails when this differs from it.
+#define BRIDGE_URGENT_MASK {0x00, 0x00, 0xC0}
+
+typedef struct
+{
+    uint8_t data[BRIDGE_FRAME_LEN];
+    uint32_t seq;      // Order of arrival over both rings
+    int64_t queued_us; // When it was queued
+    bool urgent;       // In the urgent ring
+} bridge_msg_t;
+
+// Lock-free ring of one producer (the UART task) and one consumer (the notify task). head and
+// tail run freely and are masked on access, so all BRIDGE_QUEUE_LEN slots are used. The producer
+// publishes a frame with a release store of head, the consumer frees its slot with a release
+// store (or CAS) of tail. Under BRIDGE_DROP_OLDEST the producer makes room by moving tail with a
+// CAS, so the consumer copies a frame out before it claims it with a CAS of its own, and a copy
+// that lost the race is taken again. Slots are copied in words with relaxed atomics, as such a
+// copy may overlap the producer rewriting the slot. The GCC builtins work from C on the ESP32
+// and from C++ on the desktop alike.
+typedef union
+{
+    bridge_msg_t msg;
+    uint32_t words[sizeof(bridge_msg_t) / sizeof(uint32_t)];
+} bridge_slot_t;
+
+typedef char bridge_slot_check[(sizeof(bridge_msg_t) % sizeof(uint32_t) == 0) ? 1 : -1];
+
+typedef struct
+{
+    bridge_slot_t slots[BRIDGE_QUEUE_LEN];
+    uint32_t head;    // Frames pushed, written by the producer
+    uint32_t tail;    // Frames taken or dropped as oldest
+    uint32_t dropped; // Frames lost to a full ring, written by the producer
+    int policy;       // BRIDGE_DROP_NEWEST or BRIDGE_DROP_OLDEST
+} bridge_ring_t;
+
+typedef struct
+{
+    bridge_ring_t urgent; // Room of its own, a flood of normal frames cannot drop an urgent one
+    bridge_ring_t normal;
+    framing_decoder_t decoder;
+    uint8_t last[BRIDGE_FRAME_LEN]; // Newest frame received, urgent bits are compared against it
+    uint32_t seq;
+    uint32_t received;   // Valid frames from the UART
+    uint32_t superseded; // Frames a newer one stood for in latest-value mode
+    uint32_t sent;       // Frames in notifications the BLE stack took
+    uint32_t failed;     // Notifications it refused, their frames were packed again
+    bridge_msg_t held[BRIDGE_PACKED_MAX / BRIDGE_RECORD_LEN]; // Frames of the last notification until it was taken
+    int held_count;
+    int64_t urgent_worst_us; // Longest an urgent frame was queued
+    int policy; // BRIDGE_DROP_NEWEST or BRIDGE_DROP_OLDEST of the queued mode
+    int mode;   // BRIDGE_MODE_QUEUED or BRIDGE_MODE_LATEST
+} bridge_server_t;
+
+/**
+ * @brief Set up an empty ring
+ *
+ * @param ring   The ring
+ * @param policy BRIDGE_DROP_NEWEST or BRIDGE_DROP_OLDEST
+ */
+static inline void bridge_ring_init(bridge_ring_t *ring, int policy)
+{
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->policy = policy;
+}
+
+/**
+ * @brief Queue a frame, producer only
+ *
+ * @param ring The ring
+ * @param msg  The frame
+ * @return Whether it was queued without a loss, false if the ring was full and a frame was dropped by the policy
+ */
+static inline bool bridge_ring_push(bridge_ring_t *ring, const bridge_msg_t *msg)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    bool lossless = true;
+
+    if (head - tail >= BRIDGE_QUEUE_LEN)
+    {
+        if (ring->policy != BRIDGE_DROP_OLDEST)
+        {
+            __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+            return false;
+        }
+
+        // If the consumer took the oldest frame meanwhile, there is room without a loss.
+        if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+            lossless = false;
+        }
+    }
+
+    bridge_slot_t slot;
+    slot.msg = *msg;
+    for (size_t i = 0; i < sizeof(slot.words) / sizeof(slot.words[0]); i++)
+    {
+        __atomic_store_n(&ring->slots[head & (BRIDGE_QUEUE_LEN - 1)].words[i], slot.words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return lossless;
+}
+
+/**
+ * @brief Take the oldest frame, consumer only
+ *
+ * @param ring   The ring
+ * @param msg    Receives the frame
+ * @param before Take it only if it arrived before this seq, NULL for any frame
+ * @return Whether a frame was taken
+ */
+static inline bool bridge_ring_take(bridge_ring_t *ring, bridge_msg_t *msg, const uint32_t *before)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    while (tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+    {
+        bridge_slot_t slot;
+        for (size_t i = 0; i < sizeof(slot.words) / sizeof(slot.words[0]); i++)
+        {
+            slot.words[i] = __atomic_load_n(&ring->slots[tail & (BRIDGE_QUEUE_LEN - 1)].words[i], __ATOMIC_RELAXED);
+        }
+        *msg = slot.msg;
+        if (before != NULL && (int32_t)(msg->seq - *before) >= 0)
+        {
+            return false;
+        }
+
+        // A failed CAS means the producer dropped this frame as the oldest and may be overwriting the copy, tail is reloaded.
+        if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool bridge_ring_empty(const bridge_ring_t *ring)
+{
+    return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Number of frames in a ring
+ *
+ * @param ring The ring
+ * @return Frames queued
+ */
+static inline int bridge_ring_size(const bridge_ring_t *ring)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return (int)(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail);
+}
+
+/**
+ * @brief Set up a server bridge with empty rings
+ *
+ * @param bridge The server bridge
+ * @param policy What a full ring drops, BRIDGE_DROP_NEWEST or BRIDGE_DROP_OLDEST
+ */
+static inline void bridge_server_init(bridge_server_t *bridge, int policy)
+{
+    memset(bridge, 0, sizeof(*bridge));
+    bridge_ring_init(&bridge->urgent, policy);
+    bridge_ring_init(&bridge->normal, policy);
+    bridge->policy = policy;
+    bridge->mode = BRIDGE_MODE_QUEUED;
+}
+
+/**
+ * @brief Switch between queued and latest-value mode, called by the UART task or before the tasks start
+ *
+ * @param bridge The server bridge
+ * @param mode   BRIDGE_MODE_QUEUED or BRIDGE_MODE_LATEST
+ */
+static inline void bridge_set_mode(bridge_server_t *bridge, int mode)
+{
+    // Only the newest frames count when conflating, a full ring makes room for them.
+    int policy = (mode == BRIDGE_MODE_LATEST) ? BRIDGE_DROP_OLDEST : bridge->policy;
+    bridge->urgent.policy = policy;
+    bridge->normal.policy = policy;
+    __atomic_store_n(&bridge->mode, mode, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Encode the control frame that switches a server bridge's mode, for the desktop server
+ *
+ * @param mode BRIDGE_MODE_QUEUED or BRIDGE_MODE_LATEST
+ * @param out  At least FRAMING_ENCODED_LEN(BRIDGE_CONTROL_LEN) bytes
+ * @return Bytes to write to the UART
+ */
+static inline size_t bridge_control_mode(int mode, uint8_t *out)
+{
+    const uint8_t control[BRIDGE_CONTROL_LEN] = {BRIDGE_CONTROL_MODE, (uint8_t)mode};
+    return framing_encode(control, BRIDGE_CONTROL_LEN, out);
+}
+
+/**
+ * @brief Queue the frames in bytes received on the UART, called by the UART task only
+ *
+ * @param bridge The server bridge, set up with bridge_server_init()
+ * @param bytes  Received bytes, they may end in the middle of a frame
+ * @param length Number of bytes
+ * @param now_us Current time in us
+ * @return Number of valid frames in the bytes, queued or dropped, the caller wakes the notify task if any
+ */
+static inline int bridge_uart_rx(bridge_server_t *bridge, const uint8_t *bytes, size_t length, int64_t now_us)
+{
+    static const uint8_t urgent_mask[BRIDGE_FRAME_LEN] = BRIDGE_URGENT_MASK;
+    int frames = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        // A damaged frame is dropped alone, the decoder resyncs on the next delimiter.
+        int size = framing_feed(&bridge->decoder, bytes[i]);
+
+        if (size == BRIDGE_CONTROL_LEN && bridge->decoder.data[0] == BRIDGE_CONTROL_MODE)
+        {
+            bridge_set_mode(bridge, (bridge->decoder.data[1] == BRIDGE_MODE_LATEST) ? BRIDGE_MODE_LATEST : BRIDGE_MODE_QUEUED);
+            continue;
+        }
+        else if (size != BRIDGE_FRAME_LEN)
+        {
+            continue;
+        }
+
+        bridge_msg_t msg;
+        memcpy(msg.data, bridge->decoder.data, BRIDGE_FRAME_LEN);
+
+        msg.urgent = false;
+        for (int j = 0; j < BRIDGE_FRAME_LEN; j++)
+        {
+            msg.urgent |= ((msg.data[j] ^ bridge->last[j]) & urgent_mask[j]) != 0;
+        }
+        memcpy(bridge->last, msg.data, BRIDGE_FRAME_LEN);
+
+        msg.seq = bridge->seq++;
+        msg.queued_us = now_us;
+
+        bridge_ring_push(msg.urgent ? &bridge->urgent : &bridge->normal, &msg);
+        bridge->received++;
+        frames++;
+    }
+    return frames;
+}
+
+/**
+ * @brief Forget the partial frame after the UART driver lost received bytes, called by the UART task only
+ *
+ * The bytes up to the next delimiter are then counted as one damaged frame, the frames after it
+ * are decoded as usual.
+ *
+ * @param bridge The server bridge
+ */
+static inline void bridge_uart_resync(bridge_server_t *bridge)
+{
+    framing_reset(&bridge->decoder);
+}
+
+/**
+ * @brief Take the frame to notify next, called by the notify task only
+ *
+ * In queued mode it is the oldest urgent frame, or the oldest normal one if no urgent frame is
+ * queued, so the client gets every frame that was not dropped by a full ring and an urgent one
+ * without waiting for the normal backlog. The seq in the notification tells the client which
+ * frames it overtook and puts them back in order. In latest-value mode both rings are
+ * emptied and the newest frame stands for all of them, so after a stall the next notification
+ * carries the current state instead of a backlog.
+ *
+ * @param bridge The server bridge
+ * @param msg    Receives the frame
+ * @return Whether a frame was queued
+ */
+static inline bool bridge_next(bridge_server_t *bridge, bridge_msg_t *msg)
+{
+    if (__atomic_load_n(&bridge->mode, __ATOMIC_ACQUIRE) != BRIDGE_MODE_LATEST)
+    {
+        return bridge_ring_take(&bridge->urgent, msg, NULL) || bridge_ring_take(&bridge->normal, msg, NULL);
+    }
+
+    bridge_ring_t *rings[] = {&bridge->urgent, &bridge->normal};
+    bridge_msg_t taken;
+    int64_t urgent_us = 0; // When the oldest urgent frame was queued
+    bool urgent = false;
+    uint32_t count = 0;
+
+    // At most a ring's worth each, a producer outpacing the drain cannot keep it here.
+    for (int ring = 0; ring < 2; ring++)
+    {
+        for (int n = 0; n < BRIDGE_QUEUE_LEN && bridge_ring_take(rings[ring], &taken, NULL); n++)
+        {
+            if (taken.urgent && (!urgent || taken.queued_us < urgent_us))
+            {
+                urgent_us = taken.queued_us;
+                urgent = true;
+            }
+
+            if (count++ == 0 || (int32_t)(taken.seq - msg->seq) > 0)
+            {
+                *msg = taken;
+            }
+        }
+    }
+
+    if (count == 0)
+    {
+        return false;
+    }
+
+    // The urgent change the newest frame carries has waited since the oldest urgent frame.
+    if (urgent)
+    {
+        msg->urgent = true;
+        msg->queued_us = urgent_us;
+    }
+    bridge->superseded += count - 1;
+    return true;
+}
+
+/**
+ * @brief Account for a frame from bridge_next() once the BLE stack took its notification
+ *
+ * @param bridge The server bridge
+ * @param msg    The frame bridge_next() returned
+ * @param now_us Current time in us
+ * @return Whether it was an urgent frame that waited longer than any before it
+ */
+static inline bool bridge_sent(bridge_server_t *bridge, const bridge_msg_t *msg, int64_t now_us)
+{
+    bool worst = false;
+    bridge->sent++;
+
+    if (msg->urgent)
+    {
+        int64_t waited_us = now_us - msg->queued_us;
+        if (waited_us > bridge->urgent_worst_us)
+        {
+            bridge->urgent_worst_us = waited_us;
+            worst = true;
+        }
+    }
+    return worst;
+}
+
+/**
+ * @brief Frames lost to full rings
+ *
+ * @param bridge The server bridge
+ * @return Frames dropped by the policy of either ring
+ */
+static inline uint32_t bridge_dropped(const bridge_server_t *bridge)
+{
+    return __atomic_load_n(&bridge->urgent.dropped, __ATOMIC_RELAXED) + __atomic_load_n(&bridge->normal.dropped, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Whether a frame waits for the notify task, which sleeps until woken once this is false
+ *
+ * A wakeup sent after the check is kept by the task notification, so checking first and sleeping
+ * afterwards loses no frame.
+ *
+ * @param bridge The server bridge
+ * @return Whether either ring or a refused notification holds a frame
+ */
+static inline bool bridge_pending(const bridge_server_t *bridge)
+{
+    return bridge->held_count > 0 || !bridge_ring_empty(&bridge->urgent) || !bridge_ring_empty(&bridge->normal);
+}
+
+/**
+ * @brief Fill one notification with the frames to notify next, called by the notify task only
+ *
+ * The frames are held until bridge_notified(), so the frames of a notification the BLE stack
+ * refused are packed again ahead of the ones queued since, only as many as fit if the MTU shrank.
+ * In latest-value mode a newer frame supersedes them instead.
+ *
+ * @param bridge   The server bridge
+ * @param out      The notification value
+ * @param capacity Its size, the ATT MTU of the connection less BRIDGE_ATT_OVERHEAD
+ * @param length   Receives the bytes used
+ * @return Number of frames packed, 0 if none is queued
+ */
+static inline int bridge_pack(bridge_server_t *bridge, uint8_t *out, size_t capacity, size_t *length)
+{
+    int fit = (int)(sizeof(bridge->held) / sizeof(bridge->held[0]));
+    bridge_msg_t msg;
+    int frames = 0;
+
+    if (capacity / BRIDGE_RECORD_LEN < (size_t)fit)
+    {
+        fit = (int)(capacity / BRIDGE_RECORD_LEN);
+    }
+
+    // The urgent change a held frame carries is in the newer one, which has waited since.
+    if (bridge->held_count > 0 && __atomic_load_n(&bridge->mode, __ATOMIC_ACQUIRE) == BRIDGE_MODE_LATEST && bridge_next(bridge, &msg))
+    {
+        for (int i = 0; i < bridge->held_count; i++)
+        {
+            if (bridge->held[i].urgent && (!msg.urgent || bridge->held[i].queued_us < msg.queued_us))
+            {
+                msg.urgent = true;
+                msg.queued_us = bridge->held[i].queued_us;
+            }
+        }
+        bridge->superseded += bridge->held_count;
+        bridge->held[0] = msg;
+        bridge->held_count = 1;
+    }
+
+    while (bridge->held_count < fit && bridge_next(bridge, &bridge->held[bridge->held_count]))
+    {
+        bridge->held_count++;
+    }
+
+    *length = 0;
+    for (; frames < bridge->held_count && frames < fit; frames++)
+    {
+        const bridge_msg_t *held = &bridge->held[frames];
+        out[(*length)++] = BRIDGE_FRAME_LEN;
+        memcpy(out + *length, held->data, BRIDGE_FRAME_LEN);
+        *length += BRIDGE_FRAME_LEN;
+        out[(*length)++] = (uint8_t)held->seq;
+        out[(*length)++] = (uint8_t)(held->seq >> 8);
+    }
+    return frames;
+}
+
+/**
+ * @brief Report whether the BLE stack took the notification of bridge_pack(), called by the notify task only
+ *
+ * @param bridge The server bridge
+ * @param frames What bridge_pack() returned
+ * @param taken  Whether the notification was taken, if not its frames are packed again
+ * @param now_us Current time in us
+ * @return Whether an urgent frame in it waited longer than any before it
+ */
+static inline bool bridge_notified(bridge_server_t *bridge, int frames, bool taken, int64_t now_us)
+{
+    bool worst = false;
+
+    if (!taken)
+    {
+        bridge->failed++;
+        return false;
+    }
+
+    for (int i = 0; i < frames; i++)
+    {
+        worst |= bridge_sent(bridge, &bridge->held[i], now_us);
+    }
+    bridge->held_count -= frames;
+    memmove(bridge->held, bridge->held + frames, (size_t)bridge->held_count * sizeof(bridge->held[0]));
+    return worst;
+}
+
+/**
+ * @brief Turn a received notification into UART frames for the desktop client, in the order they were packed
+ *
+ * Each frame goes out with its seq, BRIDGE_TAGGED_LEN bytes, see bridge_overtaken().
+ *
+ * @param value    The notified attribute value
+ * @param length   Its length
+ * @param out      The UART frames
+ * @param capacity Size of out, BRIDGE_UNPACKED_MAX for any notification
+ * @return Bytes to write to the UART, 0 if the value holds no frame
+ */
+static inline size_t bridge_client_rx(const uint8_t *value, size_t length, uint8_t *out, size_t capacity)
+{
+    size_t written = 0;
+
+    // A record that is cut short or of another length ends the value, the frames before it still go out.
+    for (size_t at = 0; at + BRIDGE_RECORD_LEN <= length && value[at] == BRIDGE_FRAME_LEN; at += BRIDGE_RECORD_LEN)
+    {
+        if (written + FRAMING_ENCODED_LEN(BRIDGE_TAGGED_LEN) > capacity)
+        {
+            break;
+        }
+
+        // Framed for the desktop, which drops a frame damaged on the UART and resyncs on the next one.
+        written += framing_encode(value + at + 1, BRIDGE_TAGGED_LEN, out + written);
+    }
+    return written;
+}
+
+/**
+ * @brief Whether a frame from the client bridge holds older state than one received before it
+ *
+ * An urgent frame is notified ahead of the normal frames queued before it, those then arrive
+ * after it. They still belong to a log, in the order of their seq, but not into the current state.
+ *
+ * @param tagged A frame of BRIDGE_TAGGED_LEN bytes from bridge_client_rx()
+ * @param newest The newest seq so far, updated by a frame that is not overtaken. -1 before the first
+ *               frame and after the link was silent, a restarted server bridge counts from 0 again.
+ * @return Whether the frame was overtaken
+ */
+static inline bool bridge_overtaken(const uint8_t *tagged, int32_t *newest)
+{
+    uint16_t seq = (uint16_t)(tagged[BRIDGE_FRAME_LEN] | (tagged[BRIDGE_FRAME_LEN + 1] << 8));
+
+    if (*newest >= 0 && (int16_t)(seq - (uint16_t)*newest) < 0)
+    {
+        return true;
+    }
+    *newest = seq;
+    return false;
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+
+// Framing of the UART links, shared by the desktop and the ESP32 bridges (plain C, header only).
+//
+// A frame is the payload followed by its CRC-16/CCITT-FALSE (big endian), COBS encoded and
+// terminated by a 0x00 delimiter. COBS removes every 0x00 from the encoded bytes, so a receiver
+// that starts in the middle of a frame or loses bytes resyncs on the next delimiter, and a frame
+// with corrupted bytes fails its CRC and is dropped on its own instead of shifting all that follow.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "setting.h"
+
+#ifndef FRAMING_MAX_PAYLOAD
+#define FRAMING_MAX_PAYLOAD (BUFLEN + 2) // Longer frames are dropped by the decoder, a frame with the seq of the ESP32 bridges is the longest
+#endif
+
+#define FRAMING_DELIMITER 0x00
+#define FRAMING_CRC_LEN 2
+
+// Bytes on the wire of a frame with a payload of length bytes: code bytes, CRC and delimiter.
+#define FRAMING_ENCODED_LEN(length) ((length) + FRAMING_CRC_LEN + ((length) + FRAMING_CRC_LEN) / 254 + 2)
+
+typedef struct
+{
+    uint8_t data[FRAMING_MAX_PAYLOAD + FRAMING_CRC_LEN]; // Decoded bytes of the current frame
+    size_t length;  // Decoded bytes so far
+    uint8_t code;   // COBS code byte of the current block, 0 before the first one
+    uint8_t left;   // Bytes left in the current block
+    bool overflow;  // The current frame is longer than FRAMING_MAX_PAYLOAD, it is dropped
+    uint32_t good;  // Frames delivered
+    uint32_t bad;   // Frames dropped: bad CRC, bad COBS or too long
+} framing_decoder_t;
+
+/**
+ * @brief CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF, not reflected
+ *
+ * @param data   The bytes
+ * @param length Number of bytes
+ * @return The CRC
+ */
+static inline uint16_t framing_crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    // Byte-wise form of the bit loop, no table needed on the ESP32.
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = (uint16_t)((crc >> 8) | (crc << 8));
+        crc ^= data[i];
+        crc ^= (uint16_t)((crc & 0xFF) >> 4);
+        crc ^= (uint16_t)(crc << 12);
+        crc ^= (uint16_t)((crc & 0xFF) << 5);
+    }
+    return crc;
+}
+
+/**
+ * @brief Encode one frame
+ *
+ * @param payload The payload
+ * @param length  Its length, at most FRAMING_MAX_PAYLOAD for the receiver to accept it
+ * @param out     At least FRAMING_ENCODED_LEN(length) bytes
+ * @return Number of bytes written, the delimiter included
+ */
+static inline size_t framing_encode(const uint8_t *payload, size_t length, uint8_t *out)
+{
+    uint16_t crc = framing_crc16(payload, length);
+    size_t code_at = 0; // Where the code byte of the current block goes
+    size_t written = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length + FRAMING_CRC_LEN; i++)
+    {
+        uint8_t byte = (i < length) ? payload[i] : (uint8_t)((i == length) ? (crc >> 8) : (crc & 0xFF));
+
+        if (byte != FRAMING_DELIMITER)
+        {
+            out[written++] = byte;
+            code++;
+        }
+
+        // A zero ends the block, and so does a full block of 254 data bytes.
+        if (byte == FRAMING_DELIMITER || code == 0xFF)
+        {
+            out[code_at] = code;
+            code_at = written++;
+            code = 1;
+        }
+    }
+
+    out[code_at] = code;
+    out[written++] = FRAMING_DELIMITER;
+    return written;
+}
+
+/**
+ * @brief Reset a decoder, it takes the bytes up to the next delimiter as a partial frame and drops them
+ *
+ * @param decoder The decoder
+ */
+static inline void framing_reset(framing_decoder_t *decoder)
+{
+    decoder->length = 0;
+    decoder->code = 0;
+    decoder->left = 0;
+    decoder->overflow = false;
+}
+
+/**
+ * @brief Feed one received byte to a decoder
+ *
+ * @param decoder The decoder, zero-initialized or reset before the first byte
+ * @param byte    The byte
+ * @return Payload length if the byte completed a valid frame, the payload is in decoder->data until
+ *         the next call; -1 if it completed a damaged frame; 0 otherwise
+ */
+static inline int framing_feed(framing_decoder_t *decoder, uint8_t byte)
+{
+    if (byte == FRAMING_DELIMITER)
+    {
+        // Two delimiters in a row are an empty frame, e.g. a sender flushing the line, not an error.
+        if (decoder->code == 0)
+        {
+            return 0;
+        }
+
+        bool valid = !decoder->overflow && decoder->left == 0 && decoder->length >= FRAMING_CRC_LEN;
+        size_t length = decoder->length - FRAMING_CRC_LEN;
+
+        valid = valid && framing_crc16(decoder->data, length) == (uint16_t)((decoder->data[length] << 8) | decoder->data[length + 1]);
+        framing_reset(decoder);
+
+        if (valid)
+        {
+            decoder->good++;
+            return (int)length;
+        }
+        decoder->bad++;
+        return -1;
+    }
+
+    if (decoder->left == 0)
+    {
+        // A new block, the block before it ended with a zero unless it was a full one.
+        if (decoder->code != 0 && decoder->code != 0xFF)
+        {
+            if (decoder->length < sizeof(decoder->data))
+            {
+                decoder->data[decoder->length++] = 0;
+            }
+            else
+            {
+                decoder->overflow = true;
+            }
+        }
+
+        decoder->code = byte;
+        decoder->left = (uint8_t)(byte - 1);
+    }
+    else
+    {
+        if (decoder->length < sizeof(decoder->data))
+        {
+            decoder->data[decoder->length++] = byte;
+        }
+        else
+        {
+            decoder->overflow = true;
+        }
+        decoder->left--;
+    }
+    return 0;
+}
+
+#endif
@@ -4,35 +4,54 @@
 #define BUFLEN 3
 #define BAUDRATE 1048576
 
+#ifdef UART_SIMULATOR // The PTYs of uartsim instead of the ESP32s, see desktop/simulator
+#define SERVER_PORT "/tmp/av24tr-server"
+#define CLIENT_PORT "/tmp/av24tr-client"
+#else
 #define SERVER_PORT "/dev/ttyUSB0"
 #define CLIENT_PORT "/dev/ttyUSB1"
+#endif
 
 #ifdef __cplusplus
 
-#define SIGNAL_LIST {{{0, 8, 0, 240}, "speed"},         \
-                     {{8, 7, 0, 100}, "battery"},       \
-                     {{15, 7, -60, 60}, "temperature"}, \
-                     {{22, 1, 0, 1}, "signal-left"},    \
-                     {{23, 1, 0, 1}, "signal-right"}}
+// {start, length, min, max, period in ms, priority}, name
+#define SIGNAL_LIST {{{0, 8, 0, 240, 10, NORMAL}, "speed"},         \
+                     {{8, 7, 0, 100, 1000, BULK}, "battery"},       \
+                     {{15, 7, -60, 60, 1000, BULK}, "temperature"}, \
+                     {{22, 1, 0, 1, 20, URGENT}, "signal-left"},    \
+                     {{23, 1, 0, 1, 20, URGENT}, "signal-right"}}
 
 #include <map>
 #include <tuple>
 #include <string>
+#include <vector>
 
 // To use initialize with: Setting::Signal &signal{Setting::Signal::handle()};
 // To access a signal value: signal["speed"].start;
 
 namespace Setting
 {
+    // Send order when the link is busy, every priority has its own queue
+    enum Priority : int
+    {
+        URGENT, // Warnings and indicators, always sent first
+        NORMAL,
+        BULK,
+        PRIORITIES, // Number of priorities
+    };
 
     class Signal
     {
         struct value_t
         {
             int start, length, min, max;
+            int period;   // How often the server sends the signal, in ms
+            Priority priority;
+            int index{0}; // Position in SIGNAL_LIST, used for subscription bitmaps
         };
         using key_t = std::string;
         std::map<key_t, value_t> signal;
+        std::vector<key_t> order;
 
         Signal()
         {
@@ -40,7 +59,10 @@ namespace Setting
 #undef SIGNAL_LIST
             for (const auto &item : list)
             {
-                signal.insert({std::get<key_t>(item), std::get<value_t>(item)});
+                value_t value{std::get<value_t>(item)};
+                value.index = static_cast<int>(order.size());
+                signal.insert({std::get<key_t>(item), value});
+                order.push_back(std::get<key_t>(item));
             };
         }
 
@@ -49,6 +71,19 @@ namespace Setting
         {
             return signal[key];
         }
+        size_t size(void) const
+        {
+            return order.size();
+        }
+        const key_t &name(size_t index) const
+        {
+            return order[index];
+        }
+        int index(const key_t &key) const
+        {
+            auto it = signal.find(key);
+            return (it == signal.end()) ? -1 : it->second.index;
+        }
         static Signal &handle(void)
         {
             static Signal instance;
@@ -56,11 +91,61 @@ namespace Setting
         }
     };
     constexpr int INTERVAL{40};
+    constexpr int SYNC_INTERVAL{1000}; // Clock synchronization ping period in ms
+    constexpr int SEND_PRIORITY{0};    // SCHED_FIFO priority of the server's send thread, 0 = normal scheduling
+    constexpr int KEYFRAME_INTERVAL{1000}; // Period of full frames between the updates, bounds how long a lost update is visible
+    constexpr int CHANNELS{1};             // Vehicles carried on one connection, channel IDs 0 - CHANNELS - 1
 
     namespace TCPIP
     {
         constexpr int PORT{12345};
         const char IP[]{"127.0.0.1"};
+        constexpr int WEBSOCKET_PORT{12380}; // Browser viewers, see desktop/web/viewer.html
+    }
+
+    namespace CONTROL
+    {
+        constexpr int KEEPALIVE_INTERVAL{1000}; // Clients send at least one message per interval
+        constexpr int KEEPALIVE_TIMEOUT{5000};  // Clients that sent something before and then stay silent this long are dropped
+        constexpr int MAX_INTERVAL{1000};       // Slowest rate the server backs off to for a client that cannot keep up
+    }
+
+    namespace UART
+    {
+        constexpr int RESCAN_INTERVAL{2000}; // ms, the ESP32 is searched for again even without a hotplug event
+        constexpr int RETRY_INTERVAL{50};    // ms between attempts to open a port that is there but fails to open
+        constexpr int LIVENESS_TIMEOUT{500}; // ms without a valid frame (client) or without write progress (server) until the link counts as down
+        constexpr int NOTIFY_MODE{-1};       // Told to the server ESP32 on connect: BRIDGE_MODE_QUEUED or BRIDGE_MODE_LATEST (bridge.h), -1 keeps its build-time mode
+    }
+
+    namespace HISTORY
+    {
+        constexpr int SECONDS{60};  // The server keeps the last SECONDS of all channels for backfills
+        constexpr int INTERVAL{100}; // ms between the samples of the history
+    }
+
+    namespace RELAY
+    {
+        constexpr int PORT{12346};             // Downstream port, chained relays subscribe to it
+        constexpr int REPORT_INTERVAL{5000};   // Added latency is printed every REPORT_INTERVAL ms
+    }
+
+    // Defaults of uartsim, the PTY stand-in for the two ESP32s and the BLE link between them
+    namespace SIMULATOR
+    {
+        constexpr int DELAY{30};             // ms from the server's UART to the client's, about one BLE connection interval
+        constexpr int JITTER{20};            // ms added at random on top of DELAY, frames stay in order
+        constexpr int QUEUE{64};             // Frames the server ESP32 holds while the link is behind, newer ones are dropped
+        constexpr int REPORT_INTERVAL{5000}; // Link statistics are printed every REPORT_INTERVAL ms
+    }
+
+    // Local testing without hardware:
+    // sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+    namespace CAN
+    {
+        const char INTERFACE[]{"vcan0"};
+        constexpr unsigned int ID{0x100}; // Standard 11-bit identifier of the signal frame
+        constexpr bool FD{false};         // true = CAN-FD frames, false = classic CAN
     }
 }
 